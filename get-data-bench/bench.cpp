@@ -0,0 +1,649 @@
+// bench.cpp : offline micro-benchmarks of the tick decode, format and write
+// stages, using synthetic tickData fixtures instead of a live session.
+//
+// Each stage is timed on its own for the IntradayTick path (decodeTickData,
+// CsvSink, BinSink) and for the IntradayTickExample path (string copies and
+// iostream formatting), so any change to one stage shows up in isolation.
+//
+// With -e2e, the scraper itself is timed on replays instead: synthetic
+// captures are replayed with -r into each output format, over single and
+// many securities and whole-day and hourly chunks, both inline
+// (replay-sync) and with -a -dt 1, 2 and 4 (replay-async). Each replayed
+// response goes message by message through the same rings, end markers,
+// chunk ordering and writer as in a run, inline as in the sync eventLoop
+// or from -dt threads to a writer thread as in async mode. There is no
+// session, though: requests are not sent, nothing streams through blpapi
+// and ticks are not decoded from Elements; the decode stage is timed above.
+//
+#include "stdafx.h"
+
+#include <blpapi_datetime.h>
+#include <blpapi_name.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <direct.h>
+#include <io.h>
+
+#include "tickdecoder.h"
+#include "csvsink.h"
+#include "binsink.h"
+#include "spscring.h"
+#include "tickvalidator.h"
+#include "ticksink.h"
+#include "capture.h"
+#include "chunkplanner.h"
+
+using namespace BloombergLP;
+using namespace blpapi;
+
+namespace {
+
+	// One synthetic tick, with both the typed and the string form of its
+	// time so either decode path can be served without formatting
+	struct FakeTick {
+		Datetime				time;
+		char					timeString[32];
+		const char				*type;
+		double					value;
+		int						size;
+	};
+
+	// Field of a FakeItem, mirroring the Element accessors decodeTickData uses
+	class FakeField {
+		const FakeTick			*d_tick;
+		size_t					d_position;
+
+	public:
+		FakeField(const FakeTick *tick, size_t position)
+			: d_tick(tick), d_position(position) {}
+
+		Name name() const
+		{
+			switch (d_position) {
+			case 0: return TIME;
+			case 1: return TYPE;
+			case 2: return VALUE;
+			default: return TICK_SIZE;
+			}
+		}
+		Datetime getValueAsDatetime() const { return d_tick->time; }
+		const char *getValueAsString() const { return d_tick->type; }
+		double getValueAsFloat64() const { return d_tick->value; }
+		int getValueAsInt32() const { return d_tick->size; }
+	};
+
+	// One tickData item, in the order the API delivers its fields
+	class FakeItem {
+		const FakeTick			*d_tick;
+
+	public:
+		explicit FakeItem(const FakeTick *tick) : d_tick(tick) {}
+
+		size_t numElements() const { return 4; }
+		FakeField getElement(size_t position) const { return FakeField(d_tick, position); }
+
+		bool hasElement(const Name &name) const
+		{
+			return name == TIME || name == TYPE || name == VALUE || name == TICK_SIZE;
+		}
+		Datetime getElementAsDatetime(const Name &) const { return d_tick->time; }
+		const char *getElementAsString(const Name &name) const
+		{
+			return name == TIME ? d_tick->timeString : d_tick->type;
+		}
+		double getElementAsFloat64(const Name &) const { return d_tick->value; }
+		int getElementAsInt32(const Name &) const { return d_tick->size; }
+	};
+
+	// The inner tickData array of one message
+	class FakeTickData {
+		const FakeTick			*d_ticks;
+		size_t					d_count;
+
+	public:
+		FakeTickData(const FakeTick *ticks, size_t count)
+			: d_ticks(ticks), d_count(count) {}
+
+		size_t numValues() const { return d_count; }
+		FakeItem getValueAsElement(size_t i) const { return FakeItem(d_ticks + i); }
+	};
+
+	// Discards everything, to time formatting without the file system
+	class NullBuffer : public std::streambuf {
+	protected:
+		int overflow(int c) { return c; }
+		std::streamsize xsputn(const char *, std::streamsize n) { return n; }
+	};
+
+	const char *const TYPES[] = { "TRADE", "BID", "ASK" };
+
+	// Ticks 1-3ms apart starting 2016-05-30T13:30:00
+	void makeTicks(size_t count, std::vector<FakeTick> *ticks)
+	{
+		ticks->resize(count);
+		long long nanos = timeutil::toEpoch(2016, 5, 30, 13, 30, 0) * timeutil::NANOS_PER_SECOND;
+		srand(12345);
+		for (size_t i = 0; i < count; ++i) {
+			FakeTick &tick = (*ticks)[i];
+			nanos += (1 + rand() % 3) * 1000000LL;
+
+			long long secs = nanos / timeutil::NANOS_PER_SECOND;
+			long long day = timeutil::floorDay(secs);
+			int y;
+			unsigned m, d;
+			timeutil::civilFromDays(day / timeutil::SECONDS_PER_DAY, &y, &m, &d);
+			unsigned tod = (unsigned)(secs - day);
+			tick.time.setDate(y, m, d);
+			tick.time.setTime(tod / 3600, tod / 60 % 60, tod % 60,
+				(unsigned)(nanos % timeutil::NANOS_PER_SECOND / 1000000));
+
+			timeutil::formatTickTime(nanos, tick.timeString);
+			tick.timeString[23] = '\0';
+			tick.type = TYPES[i % 3];
+			tick.value = 100.0 + (rand() % 10000) / 1000.0;
+			tick.size = 1 + rand() % 1000;
+		}
+	}
+
+	typedef std::chrono::steady_clock Clock;
+
+	void report(const char *stage, const char *path, size_t ticks, Clock::time_point start)
+	{
+		double secs = std::chrono::duration<double>(Clock::now() - start).count();
+		std::cout << std::left << std::setw(10) << stage
+			<< std::setw(22) << path
+			<< std::right << std::setw(12) << ticks
+			<< std::setw(12) << std::fixed << std::setprecision(4) << secs
+			<< std::setw(16) << std::setprecision(0) << (secs > 0 ? ticks / secs : 0.0)
+			<< std::endl;
+	}
+
+	// Ticks per message, as delivered in one PARTIAL_RESPONSE
+	const size_t MESSAGE_TICKS = 2000;
+
+	void benchDecode(const std::vector<FakeTick> &ticks, std::vector<TickRecord> *records)
+	{
+		records->clear();
+		records->reserve(ticks.size());
+		TickRecord record = TickRecord();
+		auto out = [&](const TickRecord &tick) { records->push_back(tick); };
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < ticks.size(); i += MESSAGE_TICKS) {
+			size_t n = ticks.size() - i < MESSAGE_TICKS ? ticks.size() - i : MESSAGE_TICKS;
+			decodeTickData(FakeTickData(&ticks[i], n), record, out);
+		}
+		report("decode", "IntradayTick", records->size(), start);
+	}
+
+	// Decode straight into a sink; NullSink is the decode loop alone
+	template <typename SINK>
+	void benchDecodeInto(const std::vector<FakeTick> &ticks, const char *name, SINK sink)
+	{
+		TickRecord record = TickRecord();
+		size_t decoded = 0, bytes = 0;
+		long long checksum = 0;		// so the decode is not optimized out
+		auto out = [&](const TickRecord &tick) {
+			bytes += sink(tick);
+			checksum += tick.time ^ tick.size ^ tick.type ^ (long long)tick.value;
+			++decoded;
+		};
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < ticks.size(); i += MESSAGE_TICKS) {
+			size_t n = ticks.size() - i < MESSAGE_TICKS ? ticks.size() - i : MESSAGE_TICKS;
+			decodeTickData(FakeTickData(&ticks[i], n), record, out);
+		}
+		report("decode", name, decoded, start);
+		if (checksum == 0) {
+			std::cout << "(no ticks)" << std::endl;
+		}
+		if (bytes) {
+			std::cout << "(" << bytes / decoded << " bytes/tick)" << std::endl;
+		}
+	}
+
+	// CSV and bin files of the same ticks in one pass
+	void benchDecodeTee(const std::vector<FakeTick> &ticks, const char *csvPath,
+		const char *binPath)
+	{
+		remove(csvPath);
+		remove(binPath);
+		{
+			CsvSink csv;
+			BinSink bin;
+			csv.open(csvPath);
+			bin.open(binPath);
+			TickTypeTable types;
+			benchDecodeInto(ticks, "tee csv + bin",
+				tee(CsvTickSink<false>(&csv, &types), BinTickSink<false>(&bin)));
+		}
+		remove(csvPath);
+		remove(binPath);
+	}
+
+	// IntradayTickExample::processMessage, minus the printing
+	struct ExampleTick {
+		std::string				time;
+		std::string				type;
+		double					value;
+		int						size;
+	};
+
+	void benchExampleDecode(const std::vector<FakeTick> &ticks, std::vector<ExampleTick> *decoded)
+	{
+		decoded->clear();
+		decoded->reserve(ticks.size());
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < ticks.size(); i += MESSAGE_TICKS) {
+			size_t n = ticks.size() - i < MESSAGE_TICKS ? ticks.size() - i : MESSAGE_TICKS;
+			FakeTickData data(&ticks[i], n);
+			for (size_t j = 0; j < data.numValues(); ++j) {
+				FakeItem item = data.getValueAsElement(j);
+				ExampleTick tick;
+				tick.time = item.getElementAsString(TIME);
+				tick.type = item.getElementAsString(TYPE);
+				tick.value = item.getElementAsFloat64(VALUE);
+				tick.size = item.getElementAsInt32(TICK_SIZE);
+				decoded->push_back(tick);
+			}
+		}
+		report("decode", "IntradayTickExample", decoded->size(), start);
+	}
+
+	void benchFormat(const std::vector<TickRecord> &records)
+	{
+		char row[csv::MAX_ROW];
+		size_t bytes = 0;
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < records.size(); ++i) {
+			const TickRecord &r = records[i];
+			bytes += csv::formatRow(row, r.time, tickTypeName(r.type), r.value, r.size);
+		}
+		report("format", "csv::formatRow", records.size(), start);
+		if (bytes == 0) {
+			std::cout << "(no output)" << std::endl;
+		}
+	}
+
+	void benchExampleFormat(const std::vector<ExampleTick> &ticks)
+	{
+		NullBuffer null;
+		std::ostream out(&null);
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < ticks.size(); ++i) {
+			const ExampleTick &tick = ticks[i];
+			out.setf(std::ios::fixed, std::ios::floatfield);
+			out << tick.time << "\t"
+				<< tick.type << "\t"
+				<< std::setprecision(3)
+				<< std::showpoint << tick.value << "\t\t"
+				<< tick.size << "\t" << std::noshowpoint
+				<< std::endl;
+		}
+		report("format", "IntradayTickExample", ticks.size(), start);
+	}
+
+	void benchDateChanged(const std::vector<TickRecord> &records)
+	{
+		long long current = -1;
+		size_t changes = 0;
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < records.size(); ++i) {
+			long long day = timeutil::dayNumber(records[i].time);
+			if (day != current) {
+				current = day;
+				++changes;
+			}
+		}
+		report("date", "dayNumber compare", records.size(), start);
+		if (changes == 0) {
+			std::cout << "(no days)" << std::endl;
+		}
+	}
+
+	void benchCsvWrite(const std::vector<TickRecord> &records, const char *path)
+	{
+		remove(path);
+		Clock::time_point start = Clock::now();
+		{
+			CsvSink sink;
+			sink.open(path);
+			for (size_t i = 0; i < records.size(); ++i) {
+				const TickRecord &r = records[i];
+				sink.writeRow(r.time, tickTypeName(r.type), r.value, r.size);
+			}
+		}
+		report("write", "CsvSink", records.size(), start);
+		remove(path);
+	}
+
+	long long fileBytes(const char *path)
+	{
+		FILE *file = fopen(path, "rb");
+		if (!file) {
+			return 0;
+		}
+		fseek(file, 0, SEEK_END);
+		long long bytes = ftell(file);
+		fclose(file);
+		return bytes;
+	}
+
+	void benchBinWrite(const std::vector<TickRecord> &records, const char *path, bool packed)
+	{
+		remove(path);
+		Clock::time_point start = Clock::now();
+		{
+			BinSink sink;
+			sink.open(path);
+			if (packed) {
+				sink.enablePacking();
+			}
+			for (size_t i = 0; i < records.size(); ++i) {
+				const TickRecord &r = records[i];
+				sink.writeTick(r.time, r.type, r.value, r.size);
+			}
+		}
+		report("write", packed ? "BinSink packed" : "BinSink", records.size(), start);
+		std::cout << "(" << std::setprecision(2)
+			<< (double)fileBytes(path) / records.size() << " bytes/tick)" << std::endl;
+		remove(path);
+	}
+
+	// What the pre-CsvSink scraper did: one ofstream row and flush per tick
+	void benchStreamWrite(const std::vector<ExampleTick> &ticks, const char *path)
+	{
+		remove(path);
+		Clock::time_point start = Clock::now();
+		{
+			std::ofstream file(path, std::ios_base::app);
+			for (size_t i = 0; i < ticks.size(); ++i) {
+				const ExampleTick &tick = ticks[i];
+				file.setf(std::ios::fixed, std::ios::floatfield);
+				file << tick.time << ","
+					<< tick.type << ","
+					<< std::setprecision(3) << std::showpoint << tick.value << ","
+					<< std::noshowpoint << tick.size << std::endl;
+			}
+		}
+		report("write", "ofstream + endl", ticks.size(), start);
+		remove(path);
+	}
+
+	// -vt over batches the size of a typical response message
+	void benchValidate(const std::vector<TickRecord> &records, size_t batchSize)
+	{
+		Arena arena;
+		TickBoundary boundary = TickBoundary();
+		size_t kept = 0;
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < records.size(); i += batchSize) {
+			ArenaScope scratch(arena);
+			uint32_t count = (uint32_t)(records.size() - i < batchSize ? records.size() - i : batchSize);
+			TickValidation result;
+			validateTicks(splitTicks(&records[i], count, arena), &boundary, arena, &result);
+			kept += result.kept;
+		}
+		report("validate", "validateTicks", records.size(), start);
+		std::cout << "(" << kept << " kept)" << std::endl;
+	}
+
+	// Producer/writer hand-off through one ring, as in async mode
+	void benchRing(const std::vector<TickRecord> &records, size_t capacity)
+	{
+		SpscRing<TickRecord> ring(capacity);
+		size_t popped = 0;
+
+		Clock::time_point start = Clock::now();
+		std::thread consumer([&]() {
+			TickRecord record;
+			while (popped < records.size()) {
+				if (ring.tryPop(&record)) {
+					++popped;
+				}
+				else {
+					std::this_thread::yield();
+				}
+			}
+		});
+		for (size_t i = 0; i < records.size(); ++i) {
+			while (!ring.tryPush(records[i])) {
+				std::this_thread::yield();
+			}
+		}
+		consumer.join();
+		report("handoff", "SpscRing", popped, start);
+	}
+
+	// The -e2e matrix; 0 replay threads is a sync replay
+	const int E2E_SECURITIES[] = { 1, 16 };
+	const int E2E_CHUNK_HOURS[] = { 24, 1 };
+	const int E2E_THREADS[] = { 0, 1, 2, 4 };
+	const char *const E2E_FORMATS[] = { "csv", "bin", "null" };
+	const char *const E2E_CAPTURE = "bench_e2e.tcap";
+	const char *const E2E_RUN_DIR = "bench_e2e_run";
+
+	// Two days of ticks for each security, requested in chunkHours windows
+	// and answered MESSAGE_TICKS at a time, with every security's requests
+	// in flight at once. Returns the number of chunks.
+	size_t writeCapture(const char *path, int securities, int chunkHours, size_t ticks)
+	{
+		CaptureWriter capture;
+		if (!capture.open(path)) {
+			return 0;
+		}
+		const long long day = timeutil::toEpoch(2016, 5, 30, 0, 0, 0);
+		std::vector<TimeWindow> windows;
+		planChunks(day, day + 2 * timeutil::SECONDS_PER_DAY - 1, chunkHours, &windows);
+		const size_t chunks = windows.size();
+		for (int s = 0; s < securities; ++s) {
+			capture.writeSecurity("BENCH" + std::to_string(s) + " Equity", s * chunks, chunks);
+			for (size_t w = 0; w < chunks; ++w) {
+				capture.writeChunk(s * chunks + w, s, windows[w].start, windows[w].end);
+			}
+		}
+
+		// Every security trades the same ticks, evenly spread over 13:30 to
+		// 20:00 of each day
+		const size_t perSecurity = ticks / securities;
+		const size_t perDay = (perSecurity + 1) / 2;
+		const long long spacing = perDay ? 23400 * timeutil::NANOS_PER_SECOND / perDay : 0;
+		std::vector<TickRecord> series(perSecurity, TickRecord());
+		srand(12345);
+		for (size_t i = 0; i < perSecurity; ++i) {
+			TickRecord &tick = series[i];
+			tick.time = ((day + (long long)(i / perDay) * timeutil::SECONDS_PER_DAY + 48600)
+				* timeutil::NANOS_PER_SECOND) + (long long)(i % perDay) * spacing;
+			tick.type = (unsigned char)(TICK_TRADE + i % 3);
+			tick.value = 100.0 + (rand() % 10000) / 1000.0;
+			tick.size = 1 + rand() % 1000;
+		}
+		// Windows follow on from each other, so each starts a run of ticks
+		std::vector<size_t> firstOf(chunks + 1, perSecurity);
+		for (size_t w = 0, i = 0; w < chunks; ++w) {
+			while (i < perSecurity && series[i].time < windows[w].start * timeutil::NANOS_PER_SECOND) {
+				++i;
+			}
+			firstOf[w] = i;
+		}
+
+		// Round robin over the securities, each through its windows in order
+		std::vector<size_t> window(securities, 0), next(securities, 0);
+		for (int open = securities; open > 0; ) {
+			for (int s = 0; s < securities; ++s) {
+				size_t &w = window[s];
+				if (w == chunks) {
+					continue;
+				}
+				size_t &i = next[s];
+				size_t count = firstOf[w + 1] - i < MESSAGE_TICKS ? firstOf[w + 1] - i : MESSAGE_TICKS;
+				bool last = i + count == firstOf[w + 1];
+				capture.writeMessage((unsigned)(s * chunks + w), last ? TICK_END_OF_REQUEST : 0,
+					count ? &series[i] : NULL, count);
+				i += count;
+				if (last && ++w == chunks) {
+					--open;
+				}
+			}
+		}
+		return chunks;
+	}
+
+	// Empties and removes dir, which holds files only
+	void removeRunDir(const char *dir)
+	{
+		_finddata_t found;
+		intptr_t search = _findfirst((std::string(dir) + "\\*").c_str(), &found);
+		if (search != -1) {
+			do {
+				if (!(found.attrib & _A_SUBDIR)) {
+					remove((std::string(dir) + "\\" + found.name).c_str());
+				}
+			} while (_findnext(search, &found) == 0);
+			_findclose(search);
+		}
+		_rmdir(dir);
+	}
+
+	// Wall seconds of one scraper run in an empty directory, -1 if it could
+	// not be run
+	double runScraper(const std::string &scraper, const std::string &args)
+	{
+		removeRunDir(E2E_RUN_DIR);
+		if (_mkdir(E2E_RUN_DIR) != 0 || _chdir(E2E_RUN_DIR) != 0) {
+			return -1;
+		}
+		bool absolute = scraper.find(':') != std::string::npos || scraper[0] == '\\' || scraper[0] == '/';
+		// The outer quotes are cmd's to strip
+		std::string command = "\"\"" + std::string(absolute ? "" : "..\\") + scraper + "\" " + args
+			+ " > get-data.log 2>&1\"";
+		Clock::time_point start = Clock::now();
+		int status = system(command.c_str());
+		double secs = std::chrono::duration<double>(Clock::now() - start).count();
+		_chdir("..");
+		return status == 0 ? secs : -1;
+	}
+
+	int benchEndToEnd(const std::string &scraper, size_t ticks, const char *resultsPath)
+	{
+		std::ofstream results(resultsPath);
+		if (!results) {
+			std::cout << "Failed to open " << resultsPath << std::endl;
+			return 1;
+		}
+		results << "path,securities,chunk_hours,chunks,dispatcher_threads,format,ticks,seconds,ticks_per_sec\n";
+		std::cout << "Replay only (-r, no session, decode excluded) through " << scraper << ", "
+			<< ticks << " ticks per run" << std::endl;
+		std::cout << std::left << std::setw(14) << "PATH"
+			<< std::setw(12) << "SECURITIES"
+			<< std::setw(10) << "CHUNKS"
+			<< std::setw(6) << "-dt"
+			<< std::setw(8) << "-o"
+			<< std::right << std::setw(12) << "SECONDS"
+			<< std::setw(16) << "TICKS/SEC" << std::endl;
+
+		for (size_t s = 0; s < sizeof(E2E_SECURITIES) / sizeof(E2E_SECURITIES[0]); ++s) {
+			for (size_t h = 0; h < sizeof(E2E_CHUNK_HOURS) / sizeof(E2E_CHUNK_HOURS[0]); ++h) {
+				const int securities = E2E_SECURITIES[s], chunkHours = E2E_CHUNK_HOURS[h];
+				size_t chunks = writeCapture(E2E_CAPTURE, securities, chunkHours, ticks);
+				if (!chunks) {
+					std::cout << "Failed to write " << E2E_CAPTURE << std::endl;
+					return 1;
+				}
+				const size_t written = ticks / securities * securities;
+				for (size_t t = 0; t < sizeof(E2E_THREADS) / sizeof(E2E_THREADS[0]); ++t) {
+					for (size_t f = 0; f < sizeof(E2E_FORMATS) / sizeof(E2E_FORMATS[0]); ++f) {
+						const int threads = E2E_THREADS[t];
+						const char *path = threads ? "replay-async" : "replay-sync";
+						std::string args = std::string("-n -mi 0 -r ..\\") + E2E_CAPTURE
+							+ " -o " + E2E_FORMATS[f];
+						if (threads) {
+							args += " -a -dt " + std::to_string(threads);
+						}
+						double secs = runScraper(scraper, args);
+						if (secs < 0) {
+							std::cout << "Failed: " << scraper << " " << args << std::endl;
+							continue;
+						}
+						double rate = secs > 0 ? written / secs : 0.0;
+						std::cout << std::left << std::setw(14) << path
+							<< std::setw(12) << securities
+							<< std::setw(10) << securities * chunks
+							<< std::setw(6) << (threads ? threads : 1)
+							<< std::setw(8) << E2E_FORMATS[f]
+							<< std::right << std::setw(12) << std::fixed << std::setprecision(4) << secs
+							<< std::setw(16) << std::setprecision(0) << rate << std::endl;
+						results << path << ',' << securities << ',' << chunkHours << ','
+							<< securities * chunks << ',' << (threads ? threads : 1) << ','
+							<< E2E_FORMATS[f] << ',' << written << ',' << std::setprecision(4) << secs << ','
+							<< std::setprecision(0) << rate << '\n';
+					}
+				}
+			}
+		}
+		remove(E2E_CAPTURE);
+		removeRunDir(E2E_RUN_DIR);
+		std::cout << "Results in " << resultsPath << std::endl;
+		return 0;
+	}
+};
+
+int main(int argc, char **argv)
+{
+	if (argc > 2 && !strcmp(argv[1], "-e2e")) {
+		size_t count = argc > 3 ? (size_t)atol(argv[3]) : 1000000;
+		if (count > 0) {
+			return benchEndToEnd(argv[2], count, argc > 4 ? argv[4] : "bench_e2e.csv");
+		}
+	}
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+	if (count == 0) {
+		std::cout << "Usage: get-data-bench [numTicks = 1000000]" << '\n'
+			<< "       get-data-bench -e2e <get-data.exe> [numTicks = 1000000] [resultsFile = bench_e2e.csv]" << '\n'
+			<< "         times -r replays of synthetic captures, sync and -a -dt 1/2/4: no session, no decode"
+			<< std::endl;
+		return 1;
+	}
+
+	std::cout << "Tick pipeline micro-benchmarks, " << count << " synthetic ticks" << std::endl;
+	std::vector<FakeTick> ticks;
+	makeTicks(count, &ticks);
+
+	std::cout << std::left << std::setw(10) << "STAGE"
+		<< std::setw(22) << "PATH"
+		<< std::right << std::setw(12) << "TICKS"
+		<< std::setw(12) << "SECONDS"
+		<< std::setw(16) << "TICKS/SEC" << std::endl;
+
+	std::vector<TickRecord> records;
+	std::vector<ExampleTick> exampleTicks;
+	benchDecode(ticks, &records);
+	benchDecodeInto(ticks, "NullSink", NullSink());
+	benchExampleDecode(ticks, &exampleTicks);
+	benchDateChanged(records);
+	benchFormat(records);
+	benchExampleFormat(exampleTicks);
+	benchValidate(records, 1000);
+	benchRing(records, 65536);
+	benchCsvWrite(records, "bench_ticks.csv");
+	benchBinWrite(records, "bench_ticks.bin", false);
+	benchBinWrite(records, "bench_ticks.bin", true);
+	benchStreamWrite(exampleTicks, "bench_ticks_stream.csv");
+	benchDecodeTee(ticks, "bench_ticks_tee.csv", "bench_ticks_tee.bin");
+	return 0;
+}
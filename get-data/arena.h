@@ -0,0 +1,202 @@
+// arena.h : bump allocator for scratch that lives no longer than one event
+//
+// Allocation moves a pointer through blocks the arena keeps for good;
+// reset() rewinds to the first block without freeing any, so once the
+// blocks have grown to fit the largest event the decode path stops calling
+// malloc. Nothing allocated is destroyed, so only trivially copyable types
+// belong here. One arena per decoding thread; not thread safe.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <type_traits>
+#include <vector>
+
+class Arena {
+
+	struct Block {
+		char					*data;
+		size_t					size;
+	};
+
+	std::vector<Block>			d_blocks;
+	size_t						d_block;		// index of the block in use
+	size_t						d_used;			// bytes of it handed out
+	size_t						d_blockBytes;	// size of new blocks
+	size_t						d_highWater;	// most bytes used between resets
+
+	Arena(const Arena &);
+	Arena &operator=(const Arena &);
+
+	size_t usedBytes() const
+	{
+		size_t total = d_used;
+		for (size_t i = 0; i < d_block; ++i) {
+			total += d_blocks[i].size;
+		}
+		return total;
+	}
+
+	void *allocateSlow(size_t bytes, size_t align)
+	{
+		// The next kept block may be big enough; otherwise add one that is
+		size_t next = d_block < d_blocks.size() ? d_block + 1 : d_block;
+		while (next < d_blocks.size() && d_blocks[next].size < bytes + align) {
+			++next;
+		}
+		if (next == d_blocks.size()) {
+			Block block;
+			block.size = bytes + align > d_blockBytes ? bytes + align : d_blockBytes;
+			block.data = (char *)malloc(block.size);
+			if (!block.data) {
+				throw std::bad_alloc();
+			}
+			d_blocks.push_back(block);
+		}
+		d_block = next;
+		d_used = 0;
+		return allocate(bytes, align);
+	}
+
+public:
+
+	explicit Arena(size_t blockBytes = 64 * 1024)
+		: d_block(0)
+		, d_used(0)
+		, d_blockBytes(blockBytes)
+		, d_highWater(0)
+	{
+	}
+
+	~Arena()
+	{
+		for (size_t i = 0; i < d_blocks.size(); ++i) {
+			free(d_blocks[i].data);
+		}
+	}
+
+	// align must be a power of two
+	void *allocate(size_t bytes, size_t align = alignof(double))
+	{
+		if (d_block < d_blocks.size()) {
+			Block &block = d_blocks[d_block];
+			size_t pad = (0 - ((size_t)block.data + d_used)) & (align - 1);
+			size_t start = d_used + pad;
+			if (start + bytes <= block.size) {
+				d_used = start + bytes;
+				return block.data + start;
+			}
+		}
+		return allocateSlow(bytes, align);
+	}
+
+	template <typename T>
+	T *allocate(size_t count)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "arena memory is never destroyed");
+		return (T *)allocate(count * sizeof(T), alignof(T));
+	}
+
+	// Everything allocated since the last reset is gone
+	void reset()
+	{
+		size_t used = usedBytes();
+		if (used > d_highWater) {
+			d_highWater = used;
+		}
+		d_block = 0;
+		d_used = 0;
+	}
+
+	size_t highWaterMark() const
+	{
+		return d_highWater;
+	}
+
+	size_t capacity() const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < d_blocks.size(); ++i) {
+			total += d_blocks[i].size;
+		}
+		return total;
+	}
+};
+
+// Resets the arena when the event that used it is done
+class ArenaScope {
+
+	Arena						&d_arena;
+
+	ArenaScope(const ArenaScope &);
+	ArenaScope &operator=(const ArenaScope &);
+
+public:
+
+	explicit ArenaScope(Arena &arena)
+		: d_arena(arena)
+	{
+	}
+
+	~ArenaScope()
+	{
+		d_arena.reset();
+	}
+};
+
+// Growable array in an arena, for batches built up during one event.
+// Growing copies into new arena space; the old space is only reclaimed by
+// the reset.
+template <typename T>
+class ArenaArray {
+
+	Arena						*d_arena;
+	T							*d_data;
+	size_t						d_size;
+	size_t						d_capacity;
+
+	void grow()
+	{
+		size_t capacity = d_capacity ? d_capacity * 2 : 64;
+		T *data = d_arena->allocate<T>(capacity);
+		if (d_size) {
+			memcpy(data, d_data, d_size * sizeof(T));
+		}
+		d_data = data;
+		d_capacity = capacity;
+	}
+
+public:
+
+	explicit ArenaArray(Arena *arena)
+		: d_arena(arena)
+		, d_data(NULL)
+		, d_size(0)
+		, d_capacity(0)
+	{
+	}
+
+	void push_back(const T &item)
+	{
+		if (d_size == d_capacity) {
+			grow();
+		}
+		d_data[d_size++] = item;
+	}
+
+	// Keeps the space for reuse within the same event
+	void clear()
+	{
+		d_size = 0;
+	}
+
+	const T *data() const { return d_data; }
+	size_t size() const { return d_size; }
+	bool empty() const { return d_size == 0; }
+	const T &operator[](size_t i) const { return d_data[i]; }
+};
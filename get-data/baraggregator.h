@@ -0,0 +1,116 @@
+// baraggregator.h : OHLCV bars built from a security's ticks as they are
+// written
+//
+// Holds one open bar per tick type and nothing else. Ticks are expected in
+// time order; when one lands in a later interval, every open bar from
+// before it is complete and is passed on, so bars come out ordered by start
+// and then by type. A tick older than the open bar is folded into it.
+//
+// Intervals divide a day, so bars are aligned to midnight GMT and never
+// span two days' files.
+//
+
+#pragma once
+
+#include <limits.h>
+
+#include "timeutil.h"
+#include "tickrecord.h"
+
+struct Bar {
+	long long					start;		// epoch nanos, GMT
+	double						open;
+	double						high;
+	double						low;
+	double						close;
+	long long					volume;		// sum of tick sizes
+	unsigned					ticks;		// 0 if no bar is open
+};
+
+class BarAggregator {
+
+	long long					d_interval;		// nanos
+	long long					d_current;		// start of the newest open bar, -1 if none
+	Bar							d_bars[NUM_TICK_TYPES];
+
+	// Passes on every open bar that starts before time
+	template <typename OUT>
+	void emitBefore(long long time, OUT &out)
+	{
+		for (int type = 0; type < NUM_TICK_TYPES; ++type) {
+			Bar &bar = d_bars[type];
+			if (bar.ticks && bar.start < time) {
+				out(type, bar);
+				bar.ticks = 0;
+			}
+		}
+	}
+
+public:
+
+	explicit BarAggregator(long long intervalSeconds = 60)
+	{
+		setInterval(intervalSeconds);
+	}
+
+	// Whether bars of intervalSeconds stay aligned to midnight
+	static bool validInterval(long long intervalSeconds)
+	{
+		return intervalSeconds > 0 && timeutil::SECONDS_PER_DAY % intervalSeconds == 0;
+	}
+
+	void setInterval(long long intervalSeconds)
+	{
+		d_interval = intervalSeconds * timeutil::NANOS_PER_SECOND;
+		d_current = -1;
+		for (int type = 0; type < NUM_TICK_TYPES; ++type) {
+			d_bars[type].ticks = 0;
+		}
+	}
+
+	// out(int type, const Bar &) is called for each bar completed by tick
+	template <typename OUT>
+	void add(const TickRecord &tick, OUT &out)
+	{
+		if (tick.type >= NUM_TICK_TYPES) {
+			return;
+		}
+		long long start = tick.time - tick.time % d_interval;
+		if (start > d_current) {
+			emitBefore(start, out);
+			d_current = start;
+		}
+
+		Bar &bar = d_bars[tick.type];
+		if (!bar.ticks) {
+			bar.start = start;
+			bar.open = bar.high = bar.low = tick.value;
+			bar.volume = 0;
+		}
+		if (tick.value > bar.high) {
+			bar.high = tick.value;
+		}
+		if (tick.value < bar.low) {
+			bar.low = tick.value;
+		}
+		bar.close = tick.value;
+		bar.volume += tick.size;
+		++bar.ticks;
+	}
+
+	// Passes on the bars that end at or before time; no later tick can
+	// change them
+	template <typename OUT>
+	void flushBefore(long long time, OUT &out)
+	{
+		emitBefore(time - d_interval + 1, out);
+	}
+
+	// Passes on every open bar, complete or not
+	template <typename OUT>
+	void flush(OUT &out)
+	{
+		emitBefore(LLONG_MAX, out);
+		d_current = -1;
+	}
+};
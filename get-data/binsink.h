@@ -0,0 +1,345 @@
+// binsink.h : columnar binary tick file writer
+//
+// File layout, all little-endian and 8-byte aligned so a reader can map the
+// file and use the columns in place:
+//
+//   TickFileHeader
+//   repeated {
+//       TickBlockHeader
+//       int64   time[count]     epoch nanos, GMT
+//       float64 value[count]
+//       int32   size[count]
+//       uint8   type[count]     TickType
+//       uint16  condition[count]  CodeTable ids, TBLC blocks only
+//       uint16  exchange[count]   CodeTable ids, TBLC blocks only
+//       padding to a multiple of 8
+//   }
+//
+// Blocks are self-contained, so appending to an existing file (a rerun of
+// the same day) just adds more blocks after the header already there. A
+// block's magic says which columns it has: TBLK for the first four, TBLC
+// for all six. Since version 2 a file may hold both kinds, and so may an
+// older file appended to since, so readers go by each block's magic.
+//
+// Since version 3 the ticks of each block are in time order, a tick older
+// than the one before it starting a new block, so minTime and maxTime are
+// the first and last times; see tickstore.h for reading by time range.
+//
+// TBLZ blocks hold the same columns packed (see tickcodec.h), with the
+// packed length after the block header:
+//
+//   TickBlockHeader
+//   TickPackedHeader
+//   char    packed[bytes]
+//   padding to a multiple of 8
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "tickcodec.h"
+
+const char TICK_FILE_MAGIC[4] = { 'T', 'C', 'K', 'F' };
+const char TICK_BLOCK_MAGIC[4] = { 'T', 'B', 'L', 'K' };
+const char TICK_CODES_BLOCK_MAGIC[4] = { 'T', 'B', 'L', 'C' };
+const char TICK_PACKED_BLOCK_MAGIC[4] = { 'T', 'B', 'L', 'Z' };
+const uint32_t TICK_FILE_VERSION = 3;
+
+// Column bytes per tick: time, value, size, type
+const size_t TICK_BYTES = 8 + 8 + 4 + 1;
+// and condition, exchange in TBLC blocks
+const size_t TICK_CODE_BYTES = 2 + 2;
+
+struct TickFileHeader {
+	char						magic[4];
+	uint32_t					version;
+	uint32_t					blockCapacity;	// most ticks in any one block
+	uint32_t					reserved;
+};
+
+struct TickBlockHeader {
+	char						magic[4];
+	uint32_t					count;
+	int64_t						minTime;
+	int64_t						maxTime;
+};
+
+// TickPackedHeader flags
+const uint32_t TICK_PACKED_CODES = 1;			// condition and exchange columns
+const uint32_t TICK_PACKED_DECIMAL = 2;		// values by decimal scale, in bits 8-15
+// bits 16-23 hold the time unit
+
+struct TickPackedHeader {
+	uint32_t					bytes;
+	uint32_t					flags;
+};
+
+// Bytes taken by a block of count ticks, header included
+inline size_t tickBlockBytes(uint32_t count, bool codes = false)
+{
+	size_t bytes = sizeof(TickBlockHeader)
+		+ (size_t)count * (TICK_BYTES + (codes ? TICK_CODE_BYTES : 0));
+	return (bytes + 7) & ~(size_t)7;
+}
+
+// and by a TBLZ block of packedBytes
+inline size_t tickPackedBlockBytes(uint32_t packedBytes)
+{
+	size_t bytes = sizeof(TickBlockHeader) + sizeof(TickPackedHeader) + packedBytes;
+	return (bytes + 7) & ~(size_t)7;
+}
+
+// Appends blocks to one binary tick file; columns are held in memory only
+// while the file is open
+class BinSink {
+
+	FILE						*d_file;
+	uint32_t					d_blockCapacity;
+	std::vector<int64_t>		d_times;
+	std::vector<double>			d_values;
+	std::vector<int32_t>		d_sizes;
+	std::vector<uint8_t>		d_types;
+	std::vector<uint16_t>		d_conditions;	// empty unless d_codes
+	std::vector<uint16_t>		d_exchanges;
+	std::vector<char>			d_packed;		// the last block encoded, if packing
+	int64_t						d_minTime;
+	int64_t						d_maxTime;
+	bool						d_codes;
+	bool						d_packing;
+
+	BinSink(const BinSink &);
+	BinSink &operator=(const BinSink &);
+
+	void writePackedBlock()
+	{
+		const uint32_t count = (uint32_t)d_times.size();
+		int unit = tickcodec::timeUnit(&d_times[0], count);
+		int scale = tickcodec::decimalScale(&d_values[0], count);
+		d_packed.clear();
+		tickcodec::packTimes(&d_times[0], count, unit, d_packed);
+		tickcodec::packValues(&d_values[0], count, scale, d_packed);
+		tickcodec::packVarints(&d_sizes[0], count, true, d_packed);
+		d_packed.insert(d_packed.end(), d_types.begin(), d_types.end());
+		if (d_codes) {
+			tickcodec::packVarints(&d_conditions[0], count, false, d_packed);
+			tickcodec::packVarints(&d_exchanges[0], count, false, d_packed);
+		}
+
+		TickBlockHeader header;
+		memcpy(header.magic, TICK_PACKED_BLOCK_MAGIC, sizeof(header.magic));
+		header.count = count;
+		header.minTime = d_minTime;
+		header.maxTime = d_maxTime;
+		TickPackedHeader packed;
+		packed.bytes = (uint32_t)d_packed.size();
+		packed.flags = (d_codes ? TICK_PACKED_CODES : 0)
+			| (scale >= 0 ? TICK_PACKED_DECIMAL | (uint32_t)scale << 8 : 0)
+			| (uint32_t)unit << 16;
+
+		fwrite(&header, sizeof(header), 1, d_file);
+		fwrite(&packed, sizeof(packed), 1, d_file);
+		fwrite(&d_packed[0], 1, d_packed.size(), d_file);
+		static const char padding[8] = { 0 };
+		fwrite(padding, 1, tickPackedBlockBytes(packed.bytes)
+			- sizeof(header) - sizeof(packed) - d_packed.size(), d_file);
+	}
+
+	void writeBlock()
+	{
+		const uint32_t count = (uint32_t)d_times.size();
+		if (!d_file || count == 0) {
+			return;
+		}
+		if (d_packing) {
+			writePackedBlock();
+			clearBlock();
+			return;
+		}
+
+		TickBlockHeader header;
+		memcpy(header.magic, d_codes ? TICK_CODES_BLOCK_MAGIC : TICK_BLOCK_MAGIC,
+			sizeof(header.magic));
+		header.count = count;
+		header.minTime = d_minTime;
+		header.maxTime = d_maxTime;
+
+		fwrite(&header, sizeof(header), 1, d_file);
+		fwrite(&d_times[0], sizeof(int64_t), count, d_file);
+		fwrite(&d_values[0], sizeof(double), count, d_file);
+		fwrite(&d_sizes[0], sizeof(int32_t), count, d_file);
+		fwrite(&d_types[0], sizeof(uint8_t), count, d_file);
+		size_t written = sizeof(header) + (size_t)count * TICK_BYTES;
+		if (d_codes) {
+			fwrite(&d_conditions[0], sizeof(uint16_t), count, d_file);
+			fwrite(&d_exchanges[0], sizeof(uint16_t), count, d_file);
+			written += (size_t)count * TICK_CODE_BYTES;
+		}
+
+		static const char padding[8] = { 0 };
+		fwrite(padding, 1, tickBlockBytes(count, d_codes) - written, d_file);
+		clearBlock();
+	}
+
+	void clearBlock()
+	{
+		d_times.clear();
+		d_values.clear();
+		d_sizes.clear();
+		d_types.clear();
+		d_conditions.clear();
+		d_exchanges.clear();
+	}
+
+public:
+
+	explicit BinSink(uint32_t blockCapacity = 65536)
+		: d_file(NULL)
+		, d_blockCapacity(blockCapacity ? blockCapacity : 1)
+		, d_minTime(0)
+		, d_maxTime(0)
+		, d_codes(false)
+		, d_packing(false)
+	{
+	}
+
+	BinSink(BinSink &&other)
+		: d_file(other.d_file)
+		, d_blockCapacity(other.d_blockCapacity)
+		, d_times(std::move(other.d_times))
+		, d_values(std::move(other.d_values))
+		, d_sizes(std::move(other.d_sizes))
+		, d_types(std::move(other.d_types))
+		, d_conditions(std::move(other.d_conditions))
+		, d_exchanges(std::move(other.d_exchanges))
+		, d_packed(std::move(other.d_packed))
+		, d_minTime(other.d_minTime)
+		, d_maxTime(other.d_maxTime)
+		, d_codes(other.d_codes)
+		, d_packing(other.d_packing)
+	{
+		other.d_file = NULL;
+	}
+
+	~BinSink()
+	{
+		close();
+	}
+
+	bool open(const std::string &path)
+	{
+		close();
+		if (fopen_s(&d_file, path.c_str(), "ab") != 0) {
+			d_file = NULL;
+			return false;
+		}
+		fseek(d_file, 0, SEEK_END);
+		if (ftell(d_file) == 0) {
+			TickFileHeader header;
+			memcpy(header.magic, TICK_FILE_MAGIC, sizeof(header.magic));
+			header.version = TICK_FILE_VERSION;
+			header.blockCapacity = d_blockCapacity;
+			header.reserved = 0;
+			fwrite(&header, sizeof(header), 1, d_file);
+		}
+		d_times.reserve(d_blockCapacity);
+		d_values.reserve(d_blockCapacity);
+		d_sizes.reserve(d_blockCapacity);
+		d_types.reserve(d_blockCapacity);
+		return true;
+	}
+
+	bool isOpen() const
+	{
+		return d_file != NULL;
+	}
+
+	void close()
+	{
+		if (d_file) {
+			writeBlock();
+			fclose(d_file);
+			d_file = NULL;
+		}
+		std::vector<int64_t>().swap(d_times);
+		std::vector<double>().swap(d_values);
+		std::vector<int32_t>().swap(d_sizes);
+		std::vector<uint8_t>().swap(d_types);
+		std::vector<uint16_t>().swap(d_conditions);
+		std::vector<uint16_t>().swap(d_exchanges);
+		std::vector<char>().swap(d_packed);
+	}
+
+	// Blocks from here on carry the code columns
+	void enableCodes()
+	{
+		if (d_codes) {
+			return;
+		}
+		writeBlock();
+		d_codes = true;
+		d_conditions.reserve(d_blockCapacity);
+		d_exchanges.reserve(d_blockCapacity);
+	}
+
+	// Blocks from here on are packed
+	void enablePacking()
+	{
+		if (d_packing) {
+			return;
+		}
+		writeBlock();
+		d_packing = true;
+	}
+
+	// Ends the current block early so everything so far is on disk
+	void flush()
+	{
+		if (d_file) {
+			writeBlock();
+			fflush(d_file);
+		}
+	}
+
+	// Bytes in the file once flushed
+	long long tell()
+	{
+		if (!d_file) {
+			return 0;
+		}
+		flush();
+		// Append mode reports the last I/O position, not the end
+		fseek(d_file, 0, SEEK_END);
+		return _ftelli64(d_file);
+	}
+
+	void writeTick(int64_t time, uint8_t type, double value, int32_t size,
+		uint16_t condition = 0, uint16_t exchange = 0)
+	{
+		if (!d_file) {
+			return;
+		}
+		if (!d_times.empty() && time < d_maxTime) {
+			writeBlock();
+		}
+		if (d_times.empty()) {
+			d_minTime = time;
+		}
+		d_maxTime = time;
+		d_times.push_back(time);
+		d_values.push_back(value);
+		d_sizes.push_back(size);
+		d_types.push_back(type);
+		if (d_codes) {
+			d_conditions.push_back(condition);
+			d_exchanges.push_back(exchange);
+		}
+		if (d_times.size() >= d_blockCapacity) {
+			writeBlock();
+		}
+	}
+};
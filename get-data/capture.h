@@ -0,0 +1,360 @@
+// capture.h : record and replay of IntradayTickRequest responses
+//
+// File layout, all little-endian:
+//
+//   CaptureFileHeader
+//   repeated {
+//       CaptureRecordHeader
+//       payload[bytes]
+//   }
+//
+// Record kinds and their payloads:
+//
+//   CAPTURE_SECURITY  chunk = first chunk, count = number of chunks
+//                     char name[bytes]
+//   CAPTURE_CHUNK     chunk = index, count = security index
+//                     int64 start, int64 end          GMT epoch seconds
+//   CAPTURE_MESSAGE   chunk = index, flags = TICK_* record flags,
+//                     count = ticks in the message
+//                     int64   time[count]              epoch nanos, GMT
+//                     float64 value[count]
+//                     int32   size[count]
+//                     uint8   type[count]              TickType
+//                     uint16  condition[count]         CodeTable ids, version 2
+//                     uint16  exchange[count]          CodeTable ids, version 2
+//                     category\0message\0              only if failed
+//
+// The plan is written first, so a capture replays on its own without the
+// command line it was taken with. Messages follow in arrival order.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "tickrecord.h"
+
+const char CAPTURE_FILE_MAGIC[4] = { 'T', 'C', 'A', 'P' };
+const uint32_t CAPTURE_FILE_VERSION = 2;
+
+// Bytes per captured tick, by file version
+inline size_t captureTickBytes(uint32_t version)
+{
+	return 8 + 8 + 4 + 1 + (version >= 2 ? 2 + 2 : 0);
+}
+
+enum CaptureRecordKind {
+	CAPTURE_SECURITY = 1,
+	CAPTURE_CHUNK = 2,
+	CAPTURE_MESSAGE = 3
+};
+
+struct CaptureFileHeader {
+	char						magic[4];
+	uint32_t					version;
+};
+
+struct CaptureRecordHeader {
+	uint16_t					kind;
+	uint16_t					flags;
+	uint32_t					chunk;
+	uint32_t					count;
+	uint32_t					bytes;		// payload size
+};
+
+// One replayed record; the tick columns are only filled for messages
+struct CaptureRecord {
+	CaptureRecordHeader			header;
+	std::string					name;		// security name or error category
+	std::string					message;	// error message
+	long long					start;
+	long long					end;
+	std::vector<int64_t>		times;
+	std::vector<double>			values;
+	std::vector<int32_t>		sizes;
+	std::vector<uint8_t>		types;
+	std::vector<uint16_t>		conditions;	// 0 in version 1 captures
+	std::vector<uint16_t>		exchanges;
+};
+
+// Appends records to a capture file. Not thread safe; callers serialize.
+class CaptureWriter {
+
+	FILE						*d_file;
+	std::vector<int64_t>		d_times;
+	std::vector<double>			d_values;
+	std::vector<int32_t>		d_sizes;
+	std::vector<uint8_t>		d_types;
+	std::vector<uint16_t>		d_conditions;
+	std::vector<uint16_t>		d_exchanges;
+
+	CaptureWriter(const CaptureWriter &);
+	CaptureWriter &operator=(const CaptureWriter &);
+
+	void writeHeader(CaptureRecordKind kind, uint16_t flags, uint32_t chunk,
+		uint32_t count, size_t bytes)
+	{
+		CaptureRecordHeader header;
+		header.kind = (uint16_t)kind;
+		header.flags = flags;
+		header.chunk = chunk;
+		header.count = count;
+		header.bytes = (uint32_t)bytes;
+		fwrite(&header, sizeof(header), 1, d_file);
+	}
+
+public:
+
+	CaptureWriter()
+		: d_file(NULL)
+	{
+	}
+
+	~CaptureWriter()
+	{
+		close();
+	}
+
+	bool open(const std::string &path)
+	{
+		close();
+		if (fopen_s(&d_file, path.c_str(), "wb") != 0) {
+			d_file = NULL;
+			return false;
+		}
+		setvbuf(d_file, NULL, _IOFBF, 1 << 20);
+
+		CaptureFileHeader header;
+		memcpy(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic));
+		header.version = CAPTURE_FILE_VERSION;
+		fwrite(&header, sizeof(header), 1, d_file);
+		return true;
+	}
+
+	bool isOpen() const
+	{
+		return d_file != NULL;
+	}
+
+	void close()
+	{
+		if (d_file) {
+			fclose(d_file);
+			d_file = NULL;
+		}
+	}
+
+	void writeSecurity(const std::string &name, size_t firstChunk, size_t numChunks)
+	{
+		if (!d_file) {
+			return;
+		}
+		writeHeader(CAPTURE_SECURITY, 0, (uint32_t)firstChunk, (uint32_t)numChunks, name.size());
+		fwrite(name.data(), 1, name.size(), d_file);
+	}
+
+	void writeChunk(size_t index, size_t security, long long start, long long end)
+	{
+		if (!d_file) {
+			return;
+		}
+		int64_t window[2] = { start, end };
+		writeHeader(CAPTURE_CHUNK, 0, (uint32_t)index, (uint32_t)security, sizeof(window));
+		fwrite(window, sizeof(window), 1, d_file);
+	}
+
+	// ticks as decoded, before any chunk boundary or ordering is applied
+	void writeMessage(unsigned chunk, unsigned flags, const TickRecord *ticks, size_t tickCount,
+		const char *category = "", const char *message = "")
+	{
+		if (!d_file) {
+			return;
+		}
+		const uint32_t count = (uint32_t)tickCount;
+		d_times.resize(count);
+		d_values.resize(count);
+		d_sizes.resize(count);
+		d_types.resize(count);
+		d_conditions.resize(count);
+		d_exchanges.resize(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			d_times[i] = ticks[i].time;
+			d_values[i] = ticks[i].value;
+			d_sizes[i] = ticks[i].size;
+			d_types[i] = ticks[i].type;
+			d_conditions[i] = ticks[i].condition;
+			d_exchanges[i] = ticks[i].exchange;
+		}
+
+		size_t bytes = (size_t)count * captureTickBytes(CAPTURE_FILE_VERSION);
+		size_t categoryLen = 0, messageLen = 0;
+		if (flags & TICK_REQUEST_FAILED) {
+			categoryLen = strlen(category) + 1;
+			messageLen = strlen(message) + 1;
+			bytes += categoryLen + messageLen;
+		}
+
+		writeHeader(CAPTURE_MESSAGE, (uint16_t)flags, chunk, count, bytes);
+		if (count) {
+			fwrite(&d_times[0], sizeof(int64_t), count, d_file);
+			fwrite(&d_values[0], sizeof(double), count, d_file);
+			fwrite(&d_sizes[0], sizeof(int32_t), count, d_file);
+			fwrite(&d_types[0], sizeof(uint8_t), count, d_file);
+			fwrite(&d_conditions[0], sizeof(uint16_t), count, d_file);
+			fwrite(&d_exchanges[0], sizeof(uint16_t), count, d_file);
+		}
+		if (flags & TICK_REQUEST_FAILED) {
+			fwrite(category, 1, categoryLen, d_file);
+			fwrite(message, 1, messageLen, d_file);
+		}
+	}
+};
+
+// Reads a capture file record by record
+class CaptureReader {
+
+	FILE						*d_file;
+	uint32_t					d_version;
+	std::vector<char>			d_payload;
+
+	CaptureReader(const CaptureReader &);
+	CaptureReader &operator=(const CaptureReader &);
+
+public:
+
+	CaptureReader()
+		: d_file(NULL)
+		, d_version(0)
+	{
+	}
+
+	~CaptureReader()
+	{
+		close();
+	}
+
+	// False if the file is missing or not a capture of a known version
+	bool open(const std::string &path)
+	{
+		close();
+		if (fopen_s(&d_file, path.c_str(), "rb") != 0) {
+			d_file = NULL;
+			return false;
+		}
+		setvbuf(d_file, NULL, _IOFBF, 1 << 20);
+
+		CaptureFileHeader header;
+		if (fread(&header, sizeof(header), 1, d_file) != 1
+			|| memcmp(header.magic, CAPTURE_FILE_MAGIC, sizeof(header.magic))
+			|| header.version < 1 || header.version > CAPTURE_FILE_VERSION) {
+			close();
+			return false;
+		}
+		d_version = header.version;
+		return true;
+	}
+
+	void close()
+	{
+		if (d_file) {
+			fclose(d_file);
+			d_file = NULL;
+		}
+	}
+
+	// False at the end of the file or on a truncated record. Records of
+	// unknown kind are skipped.
+	bool next(CaptureRecord *record)
+	{
+		return next(record, [](uint32_t) { return true; });
+	}
+
+	// As next, skipping the messages of chunks for which keep(chunk) is
+	// false without decoding them
+	template <typename KEEP>
+	bool next(CaptureRecord *record, KEEP keep)
+	{
+		for (;;) {
+			if (!d_file || fread(&record->header, sizeof(record->header), 1, d_file) != 1) {
+				return false;
+			}
+			const CaptureRecordHeader &header = record->header;
+			d_payload.resize(header.bytes);
+			if (header.bytes && fread(&d_payload[0], 1, header.bytes, d_file) != header.bytes) {
+				return false;
+			}
+			if (header.kind == CAPTURE_MESSAGE && !keep(header.chunk)) {
+				continue;
+			}
+			const char *p = d_payload.empty() ? NULL : &d_payload[0];
+
+			switch (header.kind) {
+			case CAPTURE_SECURITY:
+				record->name.assign(p, header.bytes);
+				return true;
+
+			case CAPTURE_CHUNK: {
+				if (header.bytes < 2 * sizeof(int64_t)) {
+					return false;
+				}
+				int64_t window[2];
+				memcpy(window, p, sizeof(window));
+				record->start = window[0];
+				record->end = window[1];
+				return true;
+			}
+
+			case CAPTURE_MESSAGE: {
+				const uint32_t count = header.count;
+				const size_t tickBytes = (size_t)count * captureTickBytes(d_version);
+				if (header.bytes < tickBytes) {
+					return false;
+				}
+				record->times.resize(count);
+				record->values.resize(count);
+				record->sizes.resize(count);
+				record->types.resize(count);
+				record->conditions.assign(count, 0);
+				record->exchanges.assign(count, 0);
+				if (count) {
+					memcpy(&record->times[0], p, count * sizeof(int64_t));
+					p += count * sizeof(int64_t);
+					memcpy(&record->values[0], p, count * sizeof(double));
+					p += count * sizeof(double);
+					memcpy(&record->sizes[0], p, count * sizeof(int32_t));
+					p += count * sizeof(int32_t);
+					memcpy(&record->types[0], p, count * sizeof(uint8_t));
+					p += count * sizeof(uint8_t);
+					if (d_version >= 2) {
+						memcpy(&record->conditions[0], p, count * sizeof(uint16_t));
+						p += count * sizeof(uint16_t);
+						memcpy(&record->exchanges[0], p, count * sizeof(uint16_t));
+						p += count * sizeof(uint16_t);
+					}
+				}
+				record->name.clear();
+				record->message.clear();
+				if (header.bytes > tickBytes) {
+					const char *end = &d_payload[0] + header.bytes;
+					const char *category = p;
+					const char *categoryEnd = (const char *)memchr(category, '\0', end - category);
+					if (categoryEnd) {
+						record->name.assign(category, categoryEnd);
+						const char *message = categoryEnd + 1;
+						const char *messageEnd = (const char *)memchr(message, '\0', end - message);
+						record->message.assign(message, messageEnd ? messageEnd : end);
+					}
+				}
+				return true;
+			}
+
+			default:
+				break;
+			}
+		}
+	}
+};
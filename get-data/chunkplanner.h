@@ -0,0 +1,53 @@
+// chunkplanner.h : splits a request range into independently requested windows
+//
+
+#pragma once
+
+#include <vector>
+
+#include "timeutil.h"
+
+// Half-open [start, end) in GMT epoch seconds, except that the last window
+// of a plan keeps the caller's inclusive end
+struct TimeWindow {
+	long long	start;
+	long long	end;
+};
+
+// Splits [start, end] into windows of at most chunkHours, aligned to
+// multiples of chunkHours from midnight GMT and never crossing midnight,
+// so each window feeds exactly one per-day file.
+// chunkHours <= 0 keeps the whole range as a single window.
+inline void planChunks(long long start, long long end, int chunkHours,
+	std::vector<TimeWindow> *windows)
+{
+	if (end < start) {
+		return;
+	}
+	if (chunkHours <= 0) {
+		TimeWindow w = { start, end };
+		windows->push_back(w);
+		return;
+	}
+
+	const long long step = (long long)chunkHours * 3600;
+	const size_t planned = windows->size();
+	long long cursor = start;
+	while (cursor < end) {
+		long long day = timeutil::floorDay(cursor);
+		long long next = day + ((cursor - day) / step + 1) * step;
+		if (next > day + timeutil::SECONDS_PER_DAY) {
+			next = day + timeutil::SECONDS_PER_DAY;
+		}
+		if (next > end) {
+			next = end;
+		}
+		TimeWindow w = { cursor, next };
+		windows->push_back(w);
+		cursor = next;
+	}
+	if (windows->size() == planned) {
+		TimeWindow w = { start, end };
+		windows->push_back(w);
+	}
+}
@@ -0,0 +1,273 @@
+// csvsink.h : buffered CSV tick file writer
+//
+// Rows are formatted straight into a large user-space buffer and written in
+// blocks, instead of one iostream flush per tick.
+//
+
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "timeutil.h"
+
+namespace csv {
+
+	// Longest row formatRow can produce, type names included
+	const size_t MAX_ROW = 512;
+
+	inline char *formatUnsigned(char *p, unsigned long long v)
+	{
+		char digits[20];
+		int n = 0;
+		do {
+			digits[n++] = (char)('0' + v % 10);
+			v /= 10;
+		} while (v);
+		while (n) {
+			*p++ = digits[--n];
+		}
+		return p;
+	}
+
+	inline char *formatInt(char *p, long long v)
+	{
+		if (v < 0) {
+			*p++ = '-';
+			return formatUnsigned(p, 0ULL - (unsigned long long)v);
+		}
+		return formatUnsigned(p, (unsigned long long)v);
+	}
+
+	// Same digits as "%.3f". The scaled value is rounded directly unless it
+	// sits near a half, where only the exact binary value can decide; those,
+	// large and non-finite values go through snprintf.
+	inline char *formatFixed3(char *p, double v)
+	{
+		double x = fabs(v) * 1000.0;
+		if (x < 1.0e12) {
+			double whole = floor(x);
+			double rest = x - whole;
+			if (rest < 0.499 || rest > 0.501) {
+				unsigned long long scaled = (unsigned long long)whole + (rest > 0.5);
+				if (signbit(v)) {
+					*p++ = '-';
+				}
+				p = formatUnsigned(p, scaled / 1000);
+				*p++ = '.';
+				timeutil::putDigits(p, 3, (unsigned)(scaled % 1000));
+				return p + 3;
+			}
+		}
+
+		char tmp[64];
+		int n = snprintf(tmp, sizeof(tmp), "%.3f", v);
+		if (n < 0 || n >= (int)sizeof(tmp)) {
+			n = snprintf(tmp, sizeof(tmp), "%.3e", v);
+		}
+		memcpy(p, tmp, n);
+		return p + n;
+	}
+
+	// "time,type,value,size\n"; returns the number of chars written
+	inline size_t formatRow(char *buf, long long timeNanos, const char *type,
+		double value, int size)
+	{
+		char *p = buf;
+		timeutil::formatTickTime(timeNanos, p);
+		p += 23;
+		*p++ = ',';
+		size_t typeLen = strlen(type);
+		if (typeLen > 64) {
+			typeLen = 64;
+		}
+		memcpy(p, type, typeLen);
+		p += typeLen;
+		*p++ = ',';
+		p = formatFixed3(p, value);
+		*p++ = ',';
+		p = formatInt(p, size);
+		*p++ = '\n';
+		return p - buf;
+	}
+
+	// "time,type,value,size,condition,exchange\n", codes as CodeTable ids
+	inline size_t formatRowWithCodes(char *buf, long long timeNanos, const char *type,
+		double value, int size, unsigned condition, unsigned exchange)
+	{
+		char *p = buf + formatRow(buf, timeNanos, type, value, size) - 1;
+		*p++ = ',';
+		p = formatUnsigned(p, condition);
+		*p++ = ',';
+		p = formatUnsigned(p, exchange);
+		*p++ = '\n';
+		return p - buf;
+	}
+
+	// "start,type,open,high,low,close,volume,ticks\n"; returns the number
+	// of chars written
+	inline size_t formatBarRow(char *buf, long long startNanos, const char *type,
+		double open, double high, double low, double close,
+		long long volume, unsigned ticks)
+	{
+		char *p = buf;
+		timeutil::formatTickTime(startNanos, p);
+		p += 23;
+		*p++ = ',';
+		size_t typeLen = strlen(type);
+		if (typeLen > 64) {
+			typeLen = 64;
+		}
+		memcpy(p, type, typeLen);
+		p += typeLen;
+		const double prices[] = { open, high, low, close };
+		for (int i = 0; i < 4; ++i) {
+			*p++ = ',';
+			p = formatFixed3(p, prices[i]);
+		}
+		*p++ = ',';
+		p = formatInt(p, volume);
+		*p++ = ',';
+		p = formatUnsigned(p, ticks);
+		*p++ = '\n';
+		return p - buf;
+	}
+}
+
+// Appends to one CSV file through a block buffer that exists only while
+// the file is open
+class CsvSink {
+
+	FILE						*d_file;
+	std::vector<char>			d_buffer;
+	size_t						d_used;
+	size_t						d_bufferSize;
+
+	CsvSink(const CsvSink &);
+	CsvSink &operator=(const CsvSink &);
+
+public:
+
+	explicit CsvSink(size_t bufferSize = 1 << 20)
+		: d_file(NULL)
+		, d_used(0)
+		, d_bufferSize(bufferSize < csv::MAX_ROW ? csv::MAX_ROW : bufferSize)
+	{
+	}
+
+	CsvSink(CsvSink &&other)
+		: d_file(other.d_file)
+		, d_buffer(std::move(other.d_buffer))
+		, d_used(other.d_used)
+		, d_bufferSize(other.d_bufferSize)
+	{
+		other.d_file = NULL;
+		other.d_used = 0;
+	}
+
+	~CsvSink()
+	{
+		close();
+	}
+
+	bool open(const std::string &path)
+	{
+		close();
+		if (fopen_s(&d_file, path.c_str(), "ab") != 0) {
+			d_file = NULL;
+			return false;
+		}
+		// We do our own buffering
+		setvbuf(d_file, NULL, _IONBF, 0);
+		d_buffer.resize(d_bufferSize);
+		d_used = 0;
+		return true;
+	}
+
+	bool isOpen() const
+	{
+		return d_file != NULL;
+	}
+
+	void close()
+	{
+		if (d_file) {
+			flush();
+			fclose(d_file);
+			d_file = NULL;
+		}
+		std::vector<char>().swap(d_buffer);
+		d_used = 0;
+	}
+
+	// Returns the length of the row
+	size_t writeRow(long long timeNanos, const char *type, double value, int size)
+	{
+		if (!d_file) {
+			return 0;
+		}
+		if (d_used + csv::MAX_ROW > d_buffer.size()) {
+			flush();
+		}
+		size_t len = csv::formatRow(&d_buffer[d_used], timeNanos, type, value, size);
+		d_used += len;
+		return len;
+	}
+
+	size_t writeRow(long long timeNanos, const char *type, double value, int size,
+		unsigned condition, unsigned exchange)
+	{
+		if (!d_file) {
+			return 0;
+		}
+		if (d_used + csv::MAX_ROW > d_buffer.size()) {
+			flush();
+		}
+		size_t len = csv::formatRowWithCodes(&d_buffer[d_used], timeNanos, type, value, size,
+			condition, exchange);
+		d_used += len;
+		return len;
+	}
+
+	// Pre-formatted rows
+	void write(const char *data, size_t len)
+	{
+		if (!d_file) {
+			return;
+		}
+		if (d_used + len > d_buffer.size()) {
+			flush();
+			if (len > d_buffer.size()) {
+				fwrite(data, 1, len, d_file);
+				return;
+			}
+		}
+		memcpy(&d_buffer[d_used], data, len);
+		d_used += len;
+	}
+
+	// Hands the buffer to the OS, so readers of the file see every row
+	void flush()
+	{
+		if (d_file && d_used) {
+			fwrite(&d_buffer[0], 1, d_used, d_file);
+			fflush(d_file);
+		}
+		d_used = 0;
+	}
+
+	// Bytes in the file once everything written so far is flushed
+	long long tell()
+	{
+		if (!d_file) {
+			return 0;
+		}
+		flush();
+		// Append mode reports the last I/O position, not the end
+		fseek(d_file, 0, SEEK_END);
+		return _ftelli64(d_file);
+	}
+};
@@ -0,0 +1,232 @@
+// interntable.h : strings interned to dense integer ids, with a dictionary
+// file alongside the data
+//
+// Each distinct string gets the next id and is appended to the dictionary
+// as it is first seen:
+//
+//   id,string
+//   1,R6,IS
+//   2,N
+//
+// Reopening the dictionary keeps every id, so files appended to by several
+// runs use the same ids throughout. A table may start with fixed names at
+// fixed ids, e.g. the TickType names, which head a new dictionary.
+// Strings are written as they come, so they must not hold a newline.
+// Thread safe.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tickrecord.h"
+
+class InternTable {
+
+	std::unordered_map<std::string, unsigned>	d_ids;
+	std::vector<std::string>		d_names;		// by id
+	unsigned						d_maxId;
+	size_t							d_fixed;		// names given to the constructor
+	mutable std::mutex				d_mutex;
+	FILE							*d_file;
+
+	InternTable(const InternTable &);
+	InternTable &operator=(const InternTable &);
+
+	void add(const std::string &name)
+	{
+		d_ids[name] = (unsigned)d_names.size();
+		d_names.push_back(name);
+	}
+
+	void save(unsigned id)
+	{
+		fprintf(d_file, "%u,%s\n", id, d_names[id].c_str());
+	}
+
+public:
+
+	// Ids from 0 up to maxId; the first count of them are names
+	InternTable(unsigned maxId, const char *const *names = NULL, size_t count = 0)
+		: d_maxId(maxId)
+		, d_fixed(count)
+		, d_file(NULL)
+	{
+		for (size_t i = 0; i < count; ++i) {
+			add(names[i]);
+		}
+	}
+
+	~InternTable()
+	{
+		close();
+	}
+
+	// Loads the ids already given out and keeps the file open for more.
+	// Lines for the fixed names are only checked; other lines that do not
+	// continue the sequence are ignored. A new file starts with the fixed
+	// names.
+	bool open(const std::string &path)
+	{
+		close();
+		std::lock_guard<std::mutex> lock(d_mutex);
+		bool empty = true;
+		FILE *in;
+		if (fopen_s(&in, path.c_str(), "rb") == 0) {
+			char line[256];
+			while (fgets(line, sizeof(line), in)) {
+				empty = false;
+				char *end;
+				unsigned long id = strtoul(line, &end, 10);
+				size_t len = strlen(line);
+				if (*end != ',' || line[len - 1] != '\n' || id > d_maxId
+					|| (id >= d_fixed && id != d_names.size())) {
+					continue;
+				}
+				std::string name(end + 1, line + len - 1);
+				if (!name.empty() && name[name.size() - 1] == '\r') {
+					name.erase(name.size() - 1);
+				}
+				if (id >= d_fixed && !d_ids.count(name)) {
+					add(name);
+				}
+			}
+			fclose(in);
+		}
+		if (fopen_s(&d_file, path.c_str(), "ab") != 0) {
+			d_file = NULL;
+			return false;
+		}
+		if (empty) {
+			for (size_t id = 0; id < d_names.size(); ++id) {
+				save((unsigned)id);
+			}
+			fflush(d_file);
+		}
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(d_mutex);
+		if (d_file) {
+			fclose(d_file);
+			d_file = NULL;
+		}
+	}
+
+	// The id of name, given out now if it has none; fallback once the ids
+	// have run out
+	unsigned intern(const char *name, unsigned fallback)
+	{
+		std::lock_guard<std::mutex> lock(d_mutex);
+		std::unordered_map<std::string, unsigned>::const_iterator it = d_ids.find(name);
+		if (it != d_ids.end()) {
+			return it->second;
+		}
+		if (d_names.size() > d_maxId) {
+			return fallback;
+		}
+		unsigned id = (unsigned)d_names.size();
+		add(name);
+		if (d_file) {
+			save(id);
+			fflush(d_file);
+		}
+		return id;
+	}
+
+	// Empty for ids not given out
+	std::string name(unsigned id) const
+	{
+		std::lock_guard<std::mutex> lock(d_mutex);
+		return id < d_names.size() ? d_names[id] : std::string();
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(d_mutex);
+		return d_names.size();
+	}
+};
+
+// Remembers the last string looked up, since neighbouring ticks mostly
+// share theirs; one per decoding thread in front of a shared InternTable
+class InternCache {
+
+	InternTable						*d_table;
+	unsigned						d_fallback;
+	std::string						d_last;
+	unsigned						d_lastId;
+	bool							d_valid;
+
+public:
+
+	InternCache(InternTable *table, unsigned fallback)
+		: d_table(table)
+		, d_fallback(fallback)
+		, d_lastId(fallback)
+		, d_valid(false)
+	{
+	}
+
+	unsigned intern(const char *name)
+	{
+		if (!d_valid || d_last != name) {
+			d_lastId = d_table->intern(name, d_fallback);
+			d_last = name;
+			d_valid = true;
+		}
+		return d_lastId;
+	}
+};
+
+// Condition and exchange codes: 0 is the empty code, ids fit in 16 bits
+const unsigned CODE_OVERFLOW_ID = 65535;
+
+namespace {
+	const char *const EMPTY_CODE[] = { "" };
+};
+
+class CodeTable : public InternTable {
+public:
+	CodeTable()
+		: InternTable(CODE_OVERFLOW_ID - 1, EMPTY_CODE, 1)
+	{
+	}
+};
+
+// Tick types the API sends beyond the TickType names get ids after them,
+// up to what the uint8 type column holds
+class TickTypeTable : public InternTable {
+public:
+	TickTypeTable()
+		: InternTable(255, TICK_TYPE_NAMES, NUM_TICK_TYPES)
+	{
+	}
+};
+
+// Name of a type id, including those interned past the TickType names;
+// scratch holds the latter
+inline const char *tickTypeName(unsigned char type, const InternTable &types,
+	std::string &scratch)
+{
+	if (type < NUM_TICK_TYPES) {
+		return tickTypeName(type);
+	}
+	scratch = types.name(type);
+	return scratch.empty() ? tickTypeName(TICK_UNKNOWN) : scratch.c_str();
+}
+
+// The per-thread caches decodeTickData interns through; any may be NULL
+struct TickInterning {
+	InternCache					*types;			// unknown types only
+	InternCache					*conditions;
+	InternCache					*exchanges;
+};
@@ -30,47 +30,266 @@
 #include <blpapi_subscriptionlist.h>
 #include <blpapi_defs.h>
 
-#include <iomanip>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
-#include <sstream>
 #include <vector>
+#include <deque>
 #include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "timeutil.h"
+#include "chunkplanner.h"
+#include "spscring.h"
+#include "tickrecord.h"
+#include "csvsink.h"
+#include "binsink.h"
+#include "tickdecoder.h"
+#include "tickvalidator.h"
+#include "ticksink.h"
+#include "sharedticks.h"
+#include "interntable.h"
+#include "arena.h"
+#include "mktdatadecoder.h"
+#include "baraggregator.h"
+#include "capture.h"
+#include "tickstore.h"
+#include "manifest.h"
+#include "writerregistry.h"
+#include "requestscheduler.h"
+#include "workqueues.h"
+#include "jobfile.h"
+#include "tradingcalendar.h"
+#include "metrics.h"
+#include "logger.h"
+
 using namespace BloombergLP;
 using namespace blpapi;
 
 namespace {
-	const Name TICK_DATA("tickData");
-	const Name TICK_SIZE("size");
-	const Name TIME("time");
-	const Name TYPE("type");
-	const Name VALUE("value");
 	const Name RESPONSE_ERROR("responseError");
 	const Name CATEGORY("category");
 	const Name MESSAGE("message");
 	const Name SESSION_TERMINATED("SessionTerminated");
+	const Name REQUEST_FAILURE("RequestFailure");
+	const Name REASON("reason");
+	const Name SUBSCRIPTION_FAILURE("SubscriptionFailure");
+	const Name SUBSCRIPTION_TERMINATED("SubscriptionTerminated");
+
+	// CorrelationId class of subscriptions; their value is the security index
+	const int LIVE_CLASS_ID = 1;
+
+	// Without -ed, live runs backfill up to this far past startup
+	const long long LIVE_LEAD_SECONDS = 10;
+	// and send requests for a window only once it is this long over
+	const long long LIVE_HOLD_SECONDS = 2;
+
+	// Dictionary of condition and exchange code ids
+	const char *const CODES_FILE = "codes.dict";
+	// and of tick type ids, for the types past the TickType names
+	const char *const TYPES_FILE = "types.dict";
+
+	// What a -d job may give, and whether each takes a value; the rest
+	// belong to the daemon and its sessions
+	const struct {
+		const char *name;
+		bool value;
+	} JOB_OPTIONS[] = {
+		{ "-s", true }, { "-f", true }, { "-e", true }, { "-sd", true }, { "-ed", true },
+		{ "-ch", true }, { "-rt", true }, { "-o", true }, { "-b", true },
+		{ "-tc", true }, { "-cc", false }, { "-xc", false }, { "-z", false }, { "-vt", false },
+		{ "-ts", false },
+	};
+};
+
+// Output state of one security
+struct SecurityRequest {
+	std::string					security;
+	CsvSink						*csv_file;		// owned by d_csvFiles, NULL if none
+	BinSink						*bin_file;		// owned by d_binFiles, NULL if none
+	size_t						file_evictions;	// registry evictions when the file was looked up
+	long long					current_day;	// day number of the current file, -1 if none
+	size_t						first_chunk;	// index into d_chunks
+	size_t						num_chunks;
+	size_t						next_chunk;		// first chunk not yet fully written
+	Manifest					manifest;		// not opened for replays
+	long long					last_tick;		// newest tick written, epoch nanos
+	long long					truncated_day;	// files up to this day cut back to the manifest
+	bool						checkpoints;	// false once a chunk has failed
+	bool						backfilled;		// every chunk written; live ticks go straight to file
+	std::vector<TickRecord>		live_buffered;	// live ticks held until then
+	bool						live_written;	// since the last flushLiveFiles
+	BarAggregator				bars;			// used with -b only
+	long long					bar_truncated_day;	// as truncated_day, for bar files
+};
+
+// One sub-request over a window of a security's range, indexed by the
+// CorrelationId of its request
+struct TickChunk {
+	size_t						security;		// index into d_requests
+	TimeWindow					window;
+	std::string					end_time;		// ticks from here on belong to the next chunk
+	bool						last;
+	bool						complete;
+	bool						failed;
+	std::vector<TickRecord>		buffered;		// ticks held until earlier chunks are written
+	long long					last_second;	// second of the newest tick taken
+	int							last_second_ticks;	// ticks taken in last_second, 0 if none yet
+	int							skip;			// ticks at window.start already taken before a retry
+
+	// Guarded by d_scheduleMutex
+	size_t						endpoint;		// whose session it was last sent on
+	long long					sent_micros;
+	bool						answered;		// any message back yet
+	bool						in_flight;
+	int							attempts;		// retries sent
+	long long					not_before;		// micros; earliest time of the next retry
+	TickBoundary				boundary;		// -vt: last tick kept since the request was sent
+	unsigned					sends;			// requests sent, stamping boundary's
+};
+
+// One server from -ip and the session the requests dealt to it go out on
+struct Endpoint {
+	size_t						index;			// into d_endpoints and d_queued
+	std::string					host;
+	int							port;
+	RequestScheduler			scheduler;		// guarded by d_scheduleMutex
+	Session						*session;		// guarded by d_scheduleMutex; NULL while down
+	std::atomic<bool>			sessionEnded;
+	bool						connected;		// refdata opened since the last restart
+	unsigned long long			dispatcher;		// async: new for each dispatcher started
+	std::atomic<size_t>			nextSlot;		// its threads given one of the endpoint's rings
+};
+
+// The options of JOB_OPTIONS; -d jobs start from the command line's
+struct JobOptions {
+	std::string					security;
+	std::string					securitiesFile;
+	std::vector<std::string>	events;
+	std::string					startDateTime;
+	std::string					endDateTime;
+	bool						security_assigned;
+	bool						startDateTime_assigned;
+	bool						endDateTime_assigned;
+	int							chunkHours;
+	bool						sessionsOnly;
+	std::string					calendarFile;
+	int							maxRetries;
+	bool						binary;
+	bool						nullOutput;
+	int							barSeconds;
+	bool						conditionCodes;
+	bool						exchangeCodes;
+	bool						packBlocks;
+	bool						validate;
 };
 
 class IntradayTick {
 
-	std::string                 d_host;
+	std::vector<std::string>    d_hosts;			// from -ip, host[:port] each
 	int                         d_port;
 	std::string                 d_security;
+	std::string                 d_securitiesFile;
 	std::vector<std::string>    d_events;
 	std::string                 d_startDateTime;
 	std::string                 d_endDateTime;
+	int                         d_maxInFlight;
+	double                      d_requestsPerSecond;
+	int                         d_maxRetries;
+	int                         d_metricsInterval;
+	int                         d_chunkHours;
+	bool                        d_sessionsOnly;		// -ts
+	std::string                 d_calendarFile;		// -tc, empty for the built-in markets only
+	TradingCalendar             d_calendar;
+	bool                        d_async;
+	int                         d_dispatcherThreads;
+	int                         d_ringCapacity;
+	int                         d_maxOpenFiles;
+	int                         d_maxBufferMB;		// -mm, 0 for no limit
+	bool                        d_binary;
+	bool                        d_nullOutput;		// -o null
+	std::string                 d_publishName;		// -sm mapping, empty for none
+	std::string                 d_captureFile;
+	std::string                 d_replayFile;
+	std::string                 d_queryFile;
+	bool                        d_live;
+	std::string                 d_liveEndDateTime;
+	long long                   d_liveFrom;			// epoch nanos; earlier live ticks are the backfill's
+	long long                   d_liveEnd;			// epoch seconds
+	unsigned                    d_liveTypes;		// 1 << TickType for each live type
+	long long                   d_lastLiveFlush;	// writer thread only
+	int                         d_barSeconds;		// 0 for no bars
+	bool                        d_conditionCodes;
+	bool                        d_exchangeCodes;
+	bool                        d_packBlocks;
+	bool                        d_validate;
+	bool                        d_liveSubscribed;	// once, restarts aside
+	JobFile                     d_jobs;				// -d, not open unless a daemon
+	JobOptions                  d_jobDefaults;
+	bool                        d_jobRunning;		// planned and not yet finished
+	int                         d_jobNumber;
+	long long                   d_jobStart;			// micros
+	std::atomic<bool>           d_stopping;			// daemon read its stop line, or lost every session
+	std::atomic<int>            d_endpointsUp;		// async: endpoints not given up on
 
 	bool						d_security_assigned;
 	bool						d_startDateTime_assigned;
 	bool						d_endDateTime_assigned;
 	bool						d_non_interactive;
+	bool						d_logLevel_assigned;
 
-	std::ofstream				csv_file;
-	std::string					current_processed_date;
+	std::vector<SecurityRequest>	d_requests;
+	std::vector<TickChunk>			d_chunks;
+	std::vector<Endpoint *>			d_endpoints;
+	WorkQueues						d_queued;			// one queue per endpoint
+	std::vector<size_t>				d_retries;			// chunks waiting out their backoff
+	int								d_pendingRetries;	// retries decided but not yet queued by the writer
+	bool							d_holding;			// new requests held back for the writer
+	long long						d_holdStart;		// micros
+	std::mutex						d_scheduleMutex;	// guards the above and the endpoints' schedulers
+
+	typedef SpscRing<TickRecord>	TickRing;
+
+	std::vector<TickRing *>			d_rings;			// decoder threads to writer
+	std::vector<Arena *>			d_arenas;			// one per ring, reset after each event
+	std::vector<InternCache>		d_typeCaches;		// one per ring, used by its producer
+	std::vector<InternCache>		d_conditionCaches;
+	std::vector<InternCache>		d_exchangeCaches;
+	std::atomic<size_t>				d_nextRing;			// sync runs and replays
+	std::atomic<unsigned long long>	d_dispatchers;		// started, numbering Endpoint::dispatcher
+	std::mutex						d_sharedRingMutex;	// guards the last ring
+	std::atomic<bool>				d_backfillDone;
+	std::atomic<bool>				d_producersDone;
+	std::atomic<unsigned long long>	d_writerPasses;		// writer loops begun
+	std::atomic<size_t>				d_heldTicks;		// in chunk and live buffers; the writer's to change
+
+	size_t (IntradayTick::*d_drainRings)();			// from selectOutput
+	void (IntradayTick::*d_flushRequest)(SecurityRequest &);
+
+	SharedTickPublisher				d_publisher;		// writer thread only
+	WriterRegistry<CsvSink>			d_csvFiles;
+	WriterRegistry<BinSink>			d_binFiles;
+	WriterRegistry<CsvSink>			d_barFiles;
+	CodeTable						d_codes;
+	TickTypeTable					d_types;
+
+	Metrics							d_metrics;
+	long long						d_startMicros;		// reporting thread only, as are the next three
+	long long						d_lastReport;
+	uint64_t						d_lastTicks;
+	uint64_t						d_lastBytes;
+
+	CaptureWriter					d_capture;
+	std::mutex						d_captureMutex;
+
+	Logger							d_log;
 
 
 	void printUsage()
@@ -79,24 +298,134 @@ class IntradayTick {
 			<< "Usage:" << '\n'
 			<< "  Retrieve intraday rawticks " << '\n'
 			<< "    [-n		:non-interactive" << '\n'
+			<< "    [-v     <logLevel = error/warn/info/debug (info, warn with -n)>" << '\n'
 			<< "    [-s     <security = IBM US Equity>" << '\n'
+			<< "    [-f     <file with one security per line>" << '\n'
 			<< "    [-e     <event = TRADE/BID/ASK>" << '\n'
 			<< "    [-sd    <startDateTime  = 2008-08-11T15:30:00>" << '\n'
 			<< "    [-ed    <endDateTime    = 2008-08-11T15:35:00>" << '\n'
-			<< "    [-ip    <ipAddress = localhost>" << '\n'
+			<< "    [-ip    <host[:port] = localhost, repeat for more sessions>" << '\n'
 			<< "    [-p     <tcpPort   = 8194>" << '\n'
+			<< "    [-mr    <maxRequestsInFlight = 50>" << '\n'
+			<< "    [-rps   <requestsPerSecond = 0 (no limit)>" << '\n'
+			<< "    [-rt    <maxRetries = 5>" << '\n'
+			<< "    [-mi    <metricsIntervalSeconds = 10 (0: at exit only)>" << '\n'
+			<< "    [-ch    <chunkHours = 0 (whole range)>" << '\n'
+			<< "    [-ts    :request trading sessions only" << '\n'
+			<< "    [-tc    <calendarFile of markets and holidays, implies -ts>" << '\n'
+			<< "    [-a     :asynchronous decode and write" << '\n'
+			<< "    [-dt    <dispatcherThreads = 1>" << '\n'
+			<< "    [-q     <tickRingCapacity = 65536>" << '\n'
+			<< "    [-fh    <maxOpenFiles = 64>" << '\n'
+			<< "    [-mm    <maxBufferMB = 256 (0: no limit)>" << '\n'
+			<< "    [-o     <outputFormat = csv/bin/null>" << '\n'
+			<< "    [-c     <capture responses to file>" << '\n'
+			<< "    [-r     <replay responses from capture file>" << '\n'
+			<< "    [-rq    <read -sd..-ed back from the bin files into CSV file>" << '\n'
+			<< "    [-l     :then stay subscribed to //blp/mktdata" << '\n'
+			<< "    [-le    <liveEndDateTime = next midnight GMT>" << '\n'
+			<< "    [-b     <barSeconds = 0 (no bars)>" << '\n'
+			<< "    [-cc    :include condition codes" << '\n'
+			<< "    [-xc    :include exchange codes" << '\n'
+			<< "    [-z     :pack bin blocks" << '\n'
+			<< "    [-vt    :drop bad, stale and repeated ticks" << '\n'
+			<< "    [-sm    <publish ticks to shared memory name>" << '\n'
+			<< "    [-d     <jobFile to take jobs from as a daemon>" << '\n'
 			<< "Notes:" << '\n'
 			<< "1) All times are in GMT." << '\n'
-			<< "2) Only one security can be specified." << std::endl;
+			<< "2) -s and -f may be combined; all securities share the sessions." << '\n'
+			<< "3) Chunks never cross midnight, so -ch 24 requests one day at a time." << '\n'
+			<< "4) With -dt above 1, partial responses of one request may be decoded" << '\n'
+			<< "   out of order; keep -dt 1 or use small -ch chunks." << '\n'
+			<< "5) -r needs no session; securities and range come from the capture." << '\n'
+			<< "   With -a, -dt threads replay a share of the securities each and" << '\n'
+			<< "   another writes, as in a run; without, one thread does both." << '\n'
+			<< "6) Each security keeps <security>.csv.manifest (or .bin.manifest) of" << '\n'
+			<< "   completed chunks; a rerun resumes after the last one. Delete it to" << '\n'
+			<< "   fetch again from -sd." << '\n'
+			<< "7) -mr and -rps are ceilings. Concurrency backs off when responses slow" << '\n'
+			<< "   down or fail with LIMIT or TIMEOUT, and recovers as they improve." << '\n'
+			<< "8) Requests failing with LIMIT, TIMEOUT, INTERNAL_ERROR or CANCELED, and" << '\n'
+			<< "   those lost with the session, are sent again for the part of their" << '\n'
+			<< "   window not yet received, backing off 1s, 2s, 4s... up to -rt times." << '\n'
+			<< "9) -n never prompts or waits for ENTER; -s or -f, -sd and -ed are then" << '\n'
+			<< "   required. Each request is logged only at -v debug." << '\n'
+			<< "10) -l subscribes to every security and appends its live ticks to the" << '\n'
+			<< "    same files once the backfill is written. Without -ed, the backfill" << '\n'
+			<< "    runs to a few seconds after startup and live ticks take over from" << '\n'
+			<< "    there. Live ticks are stamped with their arrival time. CSV files" << '\n'
+			<< "    take them within a second; bin files block by block, so follow" << '\n'
+			<< "    them with -sm instead." << '\n'
+			<< "11) -b also writes OHLCV bars of every tick type to" << '\n'
+			<< "    <security>_<date>.bars<barSeconds>.csv as ticks are written, as" << '\n'
+			<< "    start,type,open,high,low,close,volume,ticks. barSeconds must divide" << '\n'
+			<< "    a day, e.g. 1, 60 or 300." << '\n'
+			<< "12) With -cc or -xc, CSV rows end in condition,exchange and binary" << '\n'
+			<< "    blocks carry both columns, as ids from " << CODES_FILE << " in" << '\n'
+			<< "    the output directory. 0 means no code." << '\n'
+			<< "13) Tick types other than the requested ones are kept under their own" << '\n'
+			<< "    names. Binary and capture files store them as ids from" << '\n'
+			<< "    " << TYPES_FILE << " in the output directory." << '\n'
+			<< "14) -rq needs no session. It looks up each security's range in its" << '\n'
+			<< "    .bin files by their time index and writes the ticks as" << '\n'
+			<< "    security,time,type,value,size rows, plus condition,exchange with" << '\n'
+			<< "    -cc or -xc." << '\n'
+			<< "15) -z delta- and varint-encodes each block of -o bin output, several" << '\n'
+			<< "    times smaller; -rq and the manifest read such files as before." << '\n'
+			<< "16) Each -ip opens a session of its own, on -p unless given a port," << '\n'
+			<< "    with its own -mr and -rps. Securities are dealt out among them and" << '\n'
+			<< "    a session that runs out of work takes over another's, so a slow or" << '\n'
+			<< "    downed host holds back only what it has in flight. More than one" << '\n'
+			<< "    -ip implies -a; -l subscribes through the first." << '\n'
+			<< "17) -vt puts each response's ticks in time order and drops those with" << '\n'
+			<< "    a NaN value or no size, those before the last tick taken for the" << '\n'
+			<< "    request, and those at its time up to a repeat of it, as when a" << '\n'
+			<< "    response is sent again. Repeats within a response are kept." << '\n'
+			<< "    The metrics count each. Captures keep the ticks as received." << '\n'
+			<< "18) -o null fetches and decodes as usual but writes no tick files and" << '\n'
+			<< "    keeps no manifest, to measure everything up to the disk." << '\n'
+			<< "19) -sm also publishes each tick as it is written into a shared-memory" << '\n'
+			<< "    ring of " << SHARED_TICK_CAPACITY << " ticks under that name, e.g." << '\n'
+			<< "    Local\\ticks, for SharedTickReader in sharedticks.h. Readers that" << '\n'
+			<< "    fall a whole ring behind miss ticks but never slow the scraper." << '\n'
+			<< "    Type and code ids are those of " << TYPES_FILE << " and " << CODES_FILE << "." << '\n'
+			<< "20) -d starts the sessions once and runs each job added to jobFile," << '\n'
+			<< "    one line each, in turn on them. A job gives any of -s, -f, -e, -sd," << '\n'
+			<< "    -ed, -ch, -rt, -o, -b, -tc, -ts, -cc, -xc, -z and -vt, in quotes" << '\n'
+			<< "    where they contain spaces; the rest are those of the command line." << '\n'
+			<< "    A job's -o replaces the daemon's: -o csv in a job of a daemon started" << '\n'
+			<< "    with -o bin writes CSV. The file is read from the start and then" << '\n'
+			<< "    followed, and jobs already done resume past their manifests. A line" << '\n'
+			<< "    stop ends the daemon; take it out before starting it again. With" << '\n'
+			<< "    -sm, each job is a new run." << '\n'
+			<< "    -d implies -n and cannot be combined with -c, -r, -rq or -l." << '\n'
+			<< "21) Once the writer holds -mm MB of ticks waiting on earlier requests," << '\n'
+			<< "    or its rings are three quarters full, no new request goes out until" << '\n'
+			<< "    it is down to half of that and a quarter of the rings; requests in" << '\n'
+			<< "    flight still finish. Ticks in memory then stay within about -mm" << '\n'
+			<< "    plus what -mr requests return. The metrics show how long requests" << '\n'
+			<< "    were held back and decoding waited on full rings." << '\n'
+			<< "22) -ts requests each security only over its market's sessions, in -ch" << '\n'
+			<< "    chunks within each, skipping nights, weekends and holidays. The" << '\n'
+			<< "    market is the code before the yellow key, US in IBM US Equity;" << '\n'
+			<< "    US, UN, UW, UQ, LN, GY, FP, NA, JT and HK are built in, with hours" << '\n'
+			<< "    wide enough for extended trading and NYSE, LSE and TARGET holidays." << '\n'
+			<< "    Securities of other markets are requested over the whole range." << '\n'
+			<< "    -tc adds to or replaces them from a file of lines such as" << '\n'
+			<< "      market US 04:00 20:00 -5 us nyse" << '\n'
+			<< "      holiday US 2018-12-05" << '\n'
+			<< "      early US 2016-11-25 17:00" << '\n'
+			<< "    giving local times and GMT offsets; see tradingcalendar.h. Left" << '\n'
+			<< "    without -sd or -ed at the prompts, the range is the last completed" << '\n'
+			<< "    session of the first security's market, -ts or not." << std::endl;
 	}
 
-	void printErrorInfo(const char *leadingStr, const Element &errorInfo)
+	void printErrorInfo(LogLine &out, const char *leadingStr, const Element &errorInfo)
 	{
-		std::cout
-			<< leadingStr
+		out << leadingStr
 			<< errorInfo.getElementAsString(CATEGORY)
 			<< " (" << errorInfo.getElementAsString(MESSAGE)
-			<< ")" << std::endl;
+			<< ")";
 	}
 
 	bool parseCommandLine(int argc, char **argv)
@@ -106,9 +435,22 @@ class IntradayTick {
 				d_security = argv[++i];
 				d_security_assigned = true;
 			}
-			else if (!std::strcmp(argv[i], "-n") && i + 1 < argc) {
+			else if (!std::strcmp(argv[i], "-f") && i + 1 < argc) {
+				d_securitiesFile = argv[++i];
+				d_security_assigned = true;
+			}
+			else if (!std::strcmp(argv[i], "-n")) {
 				d_non_interactive = true;
 			}
+			else if (!std::strcmp(argv[i], "-v") && i + 1 < argc) {
+				LogLevel level;
+				if (!parseLogLevel(argv[++i], &level)) {
+					printUsage();
+					return false;
+				}
+				d_log.setLevel(level);
+				d_logLevel_assigned = true;
+			}
 			else if (!std::strcmp(argv[i], "-e") && i + 1 < argc) {
 				d_events.push_back(argv[++i]);
 			}
@@ -121,17 +463,131 @@ class IntradayTick {
 				d_endDateTime_assigned = true;
 			}
 			else if (!std::strcmp(argv[i], "-ip") && i + 1 < argc) {
-				d_host = argv[++i];
+				d_hosts.push_back(argv[++i]);
 			}
 			else if (!std::strcmp(argv[i], "-p") && i + 1 < argc) {
 				d_port = std::atoi(argv[++i]);
 				continue;
 			}
+			else if (!std::strcmp(argv[i], "-mr") && i + 1 < argc) {
+				d_maxInFlight = std::atoi(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-rps") && i + 1 < argc) {
+				d_requestsPerSecond = std::atof(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-rt") && i + 1 < argc) {
+				d_maxRetries = std::atoi(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-mi") && i + 1 < argc) {
+				d_metricsInterval = std::atoi(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-ch") && i + 1 < argc) {
+				d_chunkHours = std::atoi(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-ts")) {
+				d_sessionsOnly = true;
+			}
+			else if (!std::strcmp(argv[i], "-tc") && i + 1 < argc) {
+				d_calendarFile = argv[++i];
+				d_sessionsOnly = true;
+			}
+			else if (!std::strcmp(argv[i], "-a")) {
+				d_async = true;
+			}
+			else if (!std::strcmp(argv[i], "-dt") && i + 1 < argc) {
+				d_dispatcherThreads = std::atoi(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-q") && i + 1 < argc) {
+				d_ringCapacity = std::atoi(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-fh") && i + 1 < argc) {
+				d_maxOpenFiles = std::atoi(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-mm") && i + 1 < argc) {
+				d_maxBufferMB = std::atoi(argv[++i]);
+			}
+			else if (!std::strcmp(argv[i], "-o") && i + 1 < argc) {
+				++i;
+				if (std::strcmp(argv[i], "csv") && std::strcmp(argv[i], "bin")
+					&& std::strcmp(argv[i], "null")) {
+					printUsage();
+					return false;
+				}
+				// The last -o wins, so a job's replaces the daemon's
+				d_binary = !std::strcmp(argv[i], "bin");
+				d_nullOutput = !std::strcmp(argv[i], "null");
+			}
+			else if (!std::strcmp(argv[i], "-c") && i + 1 < argc) {
+				d_captureFile = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "-r") && i + 1 < argc) {
+				d_replayFile = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "-rq") && i + 1 < argc) {
+				d_queryFile = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "-l")) {
+				d_live = true;
+			}
+			else if (!std::strcmp(argv[i], "-le") && i + 1 < argc) {
+				d_liveEndDateTime = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "-cc")) {
+				d_conditionCodes = true;
+			}
+			else if (!std::strcmp(argv[i], "-xc")) {
+				d_exchangeCodes = true;
+			}
+			else if (!std::strcmp(argv[i], "-z")) {
+				d_packBlocks = true;
+			}
+			else if (!std::strcmp(argv[i], "-vt")) {
+				d_validate = true;
+			}
+			else if (!std::strcmp(argv[i], "-sm") && i + 1 < argc) {
+				d_publishName = argv[++i];
+			}
+			else if (!std::strcmp(argv[i], "-d") && i + 1 < argc) {
+				d_jobs.open(argv[++i]);
+				d_non_interactive = true;
+			}
+			else if (!std::strcmp(argv[i], "-b") && i + 1 < argc) {
+				d_barSeconds = std::atoi(argv[++i]);
+				if (d_barSeconds && !BarAggregator::validInterval(d_barSeconds)) {
+					d_log.error() << "-b " << d_barSeconds << " does not divide a day";
+					return false;
+				}
+			}
 			else {
 				printUsage();
 				return false;
 			}
 		}
+		if (d_non_interactive && !d_logLevel_assigned) {
+			d_log.setLevel(LOG_WARN);
+		}
+		if (!d_captureFile.empty() && !d_replayFile.empty()) {
+			d_log.error() << "-c and -r cannot be combined";
+			return false;
+		}
+		// -rq reads bin files whatever -o says
+		if (!d_queryFile.empty()) {
+			d_binary = true;
+			d_nullOutput = false;
+		}
+		if (d_packBlocks && !d_binary) {
+			d_log.error() << "-z needs -o bin";
+			return false;
+		}
+		if (!d_queryFile.empty() && (!d_captureFile.empty() || !d_replayFile.empty() || d_live)) {
+			d_log.error() << "-rq cannot be combined with -c, -r or -l";
+			return false;
+		}
+		if (d_jobs.isOpen() && (!d_captureFile.empty() || !d_replayFile.empty()
+			|| !d_queryFile.empty() || d_live)) {
+			d_log.error() << "-d cannot be combined with -c, -r, -rq or -l";
+			return false;
+		}
 
 		// Add desired events
 		if (d_events.size() == 0) {
@@ -139,274 +595,2527 @@ class IntradayTick {
 			d_events.push_back("BID");
 			d_events.push_back("ASK");
 		}
+		if (d_live) {
+			if (!d_replayFile.empty()) {
+				d_log.error() << "-l and -r cannot be combined";
+				return false;
+			}
+			d_liveTypes = mktdataTypeMask(d_events);
+			if (!d_liveTypes) {
+				d_log.error() << "-l streams TRADE, BID and ASK only";
+				return false;
+			}
+			if (d_liveEndDateTime.empty()) {
+				d_liveEnd = timeutil::floorDay(time(0)) + timeutil::SECONDS_PER_DAY;
+			}
+			else if (!timeutil::parseDateTime(d_liveEndDateTime, &d_liveEnd)) {
+				d_log.error() << "Bad live end " << d_liveEndDateTime;
+				return false;
+			}
+		}
+		if (d_hosts.empty()) {
+			d_hosts.push_back("localhost");
+		}
+		if (d_hosts.size() > 1) {
+			// One event loop cannot serve several sessions
+			d_async = true;
+		}
+		if (d_maxInFlight < 1) {
+			d_maxInFlight = 1;
+		}
+		if (d_dispatcherThreads < 1) {
+			d_dispatcherThreads = 1;
+		}
+		if (d_maxOpenFiles < 1) {
+			d_maxOpenFiles = 1;
+		}
+		d_csvFiles.setCapacity(d_maxOpenFiles);
+		d_binFiles.setCapacity(d_maxOpenFiles);
+		d_barFiles.setCapacity(d_maxOpenFiles);
+		selectOutput();
 		return true;
 	}
 
-	void processMessage(Message &msg)
+	// Collect securities from -s and -f into one request per security
+	bool loadSecurities()
 	{
-		// Extract data from message
-		Element data = msg.getElement(TICK_DATA).getElement(TICK_DATA);
-		int numItems = data.numValues();
+		if (!d_security.empty()) {
+			addSecurity(d_security);
+		}
+		if (!d_securitiesFile.empty()) {
+			std::ifstream list(d_securitiesFile.c_str());
+			if (!list) {
+				d_log.error() << "Failed to open " << d_securitiesFile;
+				return false;
+			}
+			std::string line;
+			while (std::getline(list, line)) {
+				// Tolerate CRLF files and blank lines
+				line.erase(line.find_last_not_of(" \t\r") + 1);
+				if (!line.empty()) {
+					addSecurity(line);
+				}
+			}
+		}
+		return !d_requests.empty();
+	}
+
+	void addSecurity(const std::string &security)
+	{
+		d_requests.push_back(SecurityRequest());
+		SecurityRequest &req = d_requests.back();
+		req.security = security;
+		req.csv_file = NULL;
+		req.bin_file = NULL;
+		req.file_evictions = 0;
+		req.current_day = -1;
+		req.last_tick = -1;
+		req.truncated_day = -1;
+		req.checkpoints = false;
+		req.backfilled = false;
+		req.live_written = false;
+		req.bars.setInterval(d_barSeconds ? d_barSeconds : 60);
+		req.bar_truncated_day = -1;
+	}
+
+	// The -sd/-ed range in epoch seconds, both ends included
+	bool requestRange(long long *start_p, long long *end_p)
+	{
+		long long &start = *start_p, &end = *end_p;
+		if (d_live && d_endDateTime.empty()) {
+			// Far enough ahead for the subscription to be up by then
+			end = time(0) + LIVE_LEAD_SECONDS;
+			if (d_startDateTime.empty()) {
+				start = timeutil::floorDay(end);
+			}
+			else if (!timeutil::parseDateTime(d_startDateTime, &start)) {
+				d_log.error() << "Bad start " << d_startDateTime;
+				return false;
+			}
+		}
+		else if (d_startDateTime.empty() || d_endDateTime.empty()) {
+			// The last session to have closed in the first security's market
+			TimeWindow session;
+			if (!d_calendar.lastSession(d_requests.empty() ? d_security : d_requests[0].security,
+				time(0), &session)) {
+				d_log.error() << "No trading session in the last month";
+				return false;
+			}
+			start = session.start;
+			end = session.end - 1;
+		}
+		else if (!timeutil::parseDateTime(d_startDateTime, &start)
+			|| !timeutil::parseDateTime(d_endDateTime, &end)) {
+			d_log.error() << "Bad date range " << d_startDateTime
+				<< " - " << d_endDateTime;
+			return false;
+		}
 
-		// Declare variables in each data row
-		std::string timeString;
-		std::string type;
-		double value;
-		int size;
+		if (end < start) {
+			d_log.error() << "Empty date range";
+			return false;
+		}
+		return true;
+	}
 
-		// Outputing necessary data including time/type/price/amount as "item" Element
-		for (int i = 0; i < numItems; ++i) {
-			Element item = data.getValueAsElement(i);
+	// Split the range of every security into chunks and queue them
+	// security by security, so out-of-order chunks only ever wait on a few
+	// earlier ones of the same security. Each security starts from its
+	// manifest's last checkpoint if that is later than the range start.
+	bool planRequests()
+	{
+		long long start, end;
+		if (!requestRange(&start, &end)) return false;
+		d_liveFrom = (end + 1) * timeutil::NANOS_PER_SECOND;
+		long long nowEpoch = time(0);
+		long long nowSteady = nowMicros();
 
-			timeString = item.getElementAsString(TIME);
-			type = item.getElementAsString(TYPE);
-			value = item.getElementAsFloat64(VALUE);
-			size = item.getElementAsInt32(TICK_SIZE);
+		for (size_t s = 0; s < d_requests.size(); ++s) {
+			SecurityRequest &req = d_requests[s];
+			std::vector<TimeWindow> windows;
+			planWindows(req.security, resumePoint(req, start), end, &windows);
 
-			// @TODO Refactor into a file class
-			if (dateChanged(timeString)) {
-				reloadCSV(timeString);
+			req.first_chunk = d_chunks.size();
+			req.num_chunks = windows.size();
+			req.next_chunk = 0;
+			for (size_t w = 0; w < windows.size(); ++w) {
+				d_chunks.push_back(TickChunk());
+				TickChunk &chunk = d_chunks.back();
+				chunk.security = s;
+				chunk.window = windows[w];
+				chunk.end_time = timeutil::formatDateTime(windows[w].end);
+				chunk.last = w + 1 == windows.size();
+				chunk.complete = false;
+				chunk.failed = false;
+				if (d_live && windows[w].end + LIVE_HOLD_SECONDS > nowEpoch) {
+					// Not over yet; held back like a retry until it is
+					chunk.not_before = nowSteady
+						+ (windows[w].end + LIVE_HOLD_SECONDS - nowEpoch) * 1000000;
+					d_retries.push_back(req.first_chunk + w);
+				}
+				else {
+					d_queued.pushBack(s % d_queued.queues(), req.first_chunk + w);
+				}
 			}
+			req.backfilled = req.num_chunks == 0;
+		}
+		if (d_queued.empty() && d_retries.empty()) {
+			d_log.info() << (d_sessionsOnly ? "Every trading session is already written up to "
+				: "Every security is already written up to ") << timeutil::formatDateTime(end);
+			return d_live;
+		}
+		return true;
+	}
 
-			csv_file.setf(std::ios::fixed, std::ios::floatfield);
-			csv_file
-				<< timeString << ","
-				<< type << ","
-				<< std::setprecision(3) << std::showpoint << value << ","
-				<< std::noshowpoint << size << std::endl;
+	// [start, end] in -ch chunks; with -ts, only its market's sessions within
+	// it, each chunked on its own
+	void planWindows(const std::string &security, long long start, long long end,
+		std::vector<TimeWindow> *windows)
+	{
+		std::vector<TimeWindow> sessions;
+		if (!d_sessionsOnly || !d_calendar.sessions(security, start, end, &sessions)) {
+			planChunks(start, end, d_chunkHours, windows);
+			return;
+		}
+		for (size_t i = 0; i < sessions.size(); ++i) {
+			planChunks(sessions[i].start, sessions[i].end, d_chunkHours, windows);
 		}
 	}
 
-	void processResponseEvent(Event &event)
+	// Opens the security's manifest; returns where its requests start
+	long long resumePoint(SecurityRequest &req, long long start)
 	{
-		MessageIterator msgIter(event);
-		while (msgIter.next()) {
-			Message msg = msgIter.message();
-			if (msg.hasElement(RESPONSE_ERROR)) {
-				printErrorInfo("REQUEST FAILED: ",
-					msg.getElement(RESPONSE_ERROR));
-				continue;
-			}
-			processMessage(msg);
+		if (d_nullOutput) {
+			return start;
+		}
+		std::string file_name = makeManifestName(req.security);
+		if (!req.manifest.open(file_name)) {
+			d_log.error() << "Failed to open " << file_name;
+			return start;
 		}
+		req.checkpoints = true;
+
+		long long resume = req.manifest.resumeFrom();
+		if (resume <= start) {
+			return start;
+		}
+		d_log.info() << req.security << ": resuming from "
+			<< timeutil::formatDateTime(resume);
+		return resume;
 	}
 
-	void sendIntradayTickRequest(Session &session)
+	static Datetime toDatetime(long long epoch)
 	{
-		Service refDataService = session.getService("//blp/refdata");
-		Request request = refDataService.createRequest("IntradayTickRequest");
+		long long day = timeutil::floorDay(epoch);
+		long long secs = epoch - day;
+		int y;
+		unsigned m, d;
+		timeutil::civilFromDays(day / timeutil::SECONDS_PER_DAY, &y, &m, &d);
 
-		// Only one security per request
-		request.set("security", d_security.c_str());
+		Datetime dt;
+		dt.setDate(y, m, d);
+		dt.setTime((unsigned)(secs / 3600), (unsigned)(secs / 60 % 60), (unsigned)(secs % 60));
+		return dt;
+	}
 
-		// Add fields to request
-		Element eventTypes = request.getElement("eventTypes");
+	// Only the oldest unfinished chunk of a security writes to its file
+	bool isHead(const TickChunk &chunk)
+	{
+		const SecurityRequest &req = d_requests[chunk.security];
+		return &chunk == &d_chunks[req.first_chunk + req.next_chunk];
+	}
 
-		for (size_t i = 0; i < d_events.size(); ++i) {
-			eventTypes.appendValue(d_events[i].c_str());
-		}
+	// Decoded ticks are also appended to captured, if given. Returns the
+	// number of ticks in the message.
+	size_t processMessage(const Message &msg, unsigned chunk, size_t slot,
+		ArenaArray<TickRecord> *captured)
+	{
+		TickRing &ring = *d_rings[slot];
+		// Extract data from message
+		Element data = msg.getElement(TICK_DATA).getElement(TICK_DATA);
 
-		// All times are in GMT
-		if (d_startDateTime.empty() || d_endDateTime.empty()) {
-			Datetime startDateTime, endDateTime;
-			if (0 == getTradingDateRange(&startDateTime, &endDateTime)) {
-				request.set("startDateTime", startDateTime);
-				request.set("endDateTime", endDateTime);
+		TickRecord record;
+		record.chunk = chunk;
+		record.flags = 0;
+
+		ArenaArray<TickRecord> batch(d_arenas[slot]);
+		auto out = [&](const TickRecord &tick) {
+			if (captured) {
+				captured->push_back(tick);
+			}
+			if (d_validate) {
+				batch.push_back(tick);
+			}
+			else {
+				pushRecord(ring, tick);
 			}
+		};
+		TickInterning interning = {
+			&d_typeCaches[slot],
+			d_conditionCodes ? &d_conditionCaches[slot] : NULL,
+			d_exchangeCodes ? &d_exchangeCaches[slot] : NULL
+		};
+		decodeTickData(data, record, out, &interning);
+		if (!batch.empty()) {
+			Arena &arena = *d_arenas[slot];
+			pushValidated(chunk, splitTicks(batch.data(), (uint32_t)batch.size(), arena), ring,
+				arena);
 		}
-		else {
-			if (!d_startDateTime.empty() && !d_endDateTime.empty()) {
-				request.set("startDateTime", d_startDateTime.c_str());
-				request.set("endDateTime", d_endDateTime.c_str());
+		return data.numValues();
+	}
+
+	// -vt: the batch's ticks that pass, in time order. The boundary is
+	// taken and put back under d_scheduleMutex, which a send resets it
+	// under; it is put back only if no send came in between, so a new
+	// request starts from its own reset.
+	void pushValidated(unsigned chunk, const TickColumns &batch, TickRing &ring, Arena &arena)
+	{
+		TickBoundary boundary;
+		unsigned sends;
+		{
+			std::lock_guard<std::mutex> lock(d_scheduleMutex);
+			boundary = d_chunks[chunk].boundary;
+			sends = d_chunks[chunk].sends;
+		}
+		TickValidation result;
+		validateTicks(batch, &boundary, arena, &result);
+		{
+			std::lock_guard<std::mutex> lock(d_scheduleMutex);
+			if (d_chunks[chunk].sends == sends) {
+				d_chunks[chunk].boundary = boundary;
 			}
 		}
+		ThreadMetrics &metrics = d_metrics.local();
+		metrics.add(COUNT_TICKS_UNORDERED, result.unordered);
+		metrics.add(COUNT_TICKS_INVALID, result.invalid);
+		metrics.add(COUNT_TICKS_STALE, result.stale);
+		metrics.add(COUNT_TICKS_DUPLICATE, result.duplicate);
 
-		std::cout << "Sending Request: " << request << std::endl;
-		session.sendRequest(request);
+		TickRecord tick = TickRecord();
+		tick.chunk = chunk;
+		for (uint32_t i = 0; i < batch.count; ++i) {
+			if (!result.keep[i]) {
+				continue;
+			}
+			uint32_t j = result.order ? result.order[i] : i;
+			tick.time = batch.times[j];
+			tick.value = batch.values[j];
+			tick.size = batch.sizes[j];
+			tick.type = batch.types[j];
+			tick.condition = batch.conditions[j];
+			tick.exchange = batch.exchanges[j];
+			pushRecord(ring, tick);
+		}
 	}
 
-	void eventLoop(Session &session)
+	// Marks the end of one message's ticks, once they are on the ring;
+	// shared by received and replayed responses
+	void endMessage(unsigned chunk, unsigned flags, size_t ticks, TickRing &ring)
 	{
-		bool done = false;
-		loadCSV();
+		ThreadMetrics &metrics = d_metrics.local();
+		metrics.add(COUNT_TICKS_DECODED, ticks);
+		metrics.add(COUNT_MESSAGES, 1);
+		if (flags) {
+			TickRecord marker = TickRecord();
+			marker.chunk = chunk;
+			marker.flags = (unsigned char)flags;
+			pushRecord(ring, marker);
+		}
+		if (!d_async) {
+			drainRings();
+		}
+	}
 
-		while (!done) {
-			Event event = session.nextEvent();
-			if (event.eventType() == Event::PARTIAL_RESPONSE) {
-				std::cout << "Processing Partial Response" << std::endl;
-				processResponseEvent(event);
-			}
-			else if (event.eventType() == Event::RESPONSE) {
-				std::cout << "Processing Response" << std::endl;
-				processResponseEvent(event);
-				done = true;
+	void pushRecord(TickRing &ring, const TickRecord &record)
+	{
+		if (ring.tryPush(record)) {
+			return;
+		}
+		long long start = nowMicros();
+		while (!ring.tryPush(record)) {
+			if (d_async) {
+				std::this_thread::yield();
 			}
 			else {
-				MessageIterator msgIter(event);
-				while (msgIter.next()) {
-					Message msg = msgIter.message();
-					if (event.eventType() == Event::SESSION_STATUS) {
-						if (msg.messageType() == SESSION_TERMINATED) {
-							done = true;
-						}
-					}
-				}
+				drainRings();
 			}
 		}
+		if (d_async) {
+			d_metrics.local().add(COUNT_RING_FULL_MICROS, nowMicros() - start);
+		}
+	}
 
-		unloadCSV();
+	// Each thread that decodes gets a ring of its own for as long as there
+	// are rings left; any further threads share the last one under a lock
+	size_t producerSlot()
+	{
+		static thread_local size_t t_slot = (size_t)-1;
+		if (t_slot == (size_t)-1) {
+			size_t slot = d_nextRing.fetch_add(1);
+			t_slot = slot + 1 < d_rings.size() ? slot : d_rings.size() - 1;
+		}
+		return t_slot;
 	}
 
-	int getTradingDateRange(Datetime *startDate_p, Datetime *endDate_p)
+	// Async: the endpoint's -dt rings go to its dispatcher's threads, dealt
+	// again for each dispatcher it starts; the one before has been stopped,
+	// its threads joined
+	size_t producerSlot(Endpoint &e)
 	{
-		struct tm *tm_p;
-		time_t currTime = time(0);
+		static thread_local unsigned long long t_dispatcher = 0;
+		static thread_local size_t t_slot = 0;
+		if (t_dispatcher != e.dispatcher) {
+			size_t k = e.nextSlot.fetch_add(1);
+			t_slot = k < (size_t)d_dispatcherThreads ? e.index * d_dispatcherThreads + k
+				: d_rings.size() - 1;
+			t_dispatcher = e.dispatcher;
+		}
+		return t_slot;
+	}
 
-		tm_p = (struct tm*) malloc(sizeof(struct tm));
+	// Writer side: only ever called from one thread at a time
+	template <typename OUTPUT>
+	void writeRecord(const TickRecord &record)
+	{
+		if (record.flags & TICK_STREAMED) {
+			writeLiveTick<OUTPUT>(record);
+			return;
+		}
+		TickChunk &chunk = d_chunks[record.chunk];
+		SecurityRequest &req = d_requests[chunk.security];
 
-		while (currTime > 0) {
-			currTime -= 86400; // GO back one day
-			localtime_s(tm_p, &currTime);
-			if (tm_p == NULL) {
-				break;
+		if (record.flags) {
+			if (record.flags & TICK_REQUEST_RETRIED) {
+				rewindChunk(chunk);
+				if (d_replayFile.empty()) {
+					scheduleRetry(record.chunk);
+				}
+				return;
 			}
-
-			// if not sunday / saturday, assign values & return
-			if (tm_p->tm_wday == 0 || tm_p->tm_wday == 6) {// Sun/Sat
-				continue;
+			if (record.flags & TICK_REQUEST_FAILED) {
+				chunk.failed = true;
 			}
+			if (record.flags & TICK_END_OF_REQUEST) {
+				chunk.complete = true;
+				advanceChunks<OUTPUT>(req);
+			}
+			return;
+		}
 
-			startDate_p->setDate(tm_p->tm_year + 1900,
-				tm_p->tm_mon + 1,
-				tm_p->tm_mday);
-			startDate_p->setTime(15, 30, 0);
+		// Boundary ticks are left to the chunk that starts there
+		if (!chunk.last && record.time >= chunk.window.end * timeutil::NANOS_PER_SECOND) {
+			return;
+		}
 
-			endDate_p->setDate(tm_p->tm_year + 1900,
-				tm_p->tm_mon + 1,
-				tm_p->tm_mday);
-			endDate_p->setTime(15, 35, 0);
+		// A retry starts at the second of the last tick taken; its first
+		// ticks of that second were taken already
+		long long second = record.time / timeutil::NANOS_PER_SECOND;
+		if (chunk.skip) {
+			if (second == chunk.window.start) {
+				--chunk.skip;
+				return;
+			}
+			chunk.skip = 0;
+		}
+		if (second != chunk.last_second) {
+			chunk.last_second = second;
+			chunk.last_second_ticks = 0;
+		}
+		++chunk.last_second_ticks;
 
-			free(tm_p);
-			return(0);
+		if (!isHead(chunk)) {
+			chunk.buffered.push_back(record);
+			holdTicks(1);
+			return;
 		}
-		free(tm_p);
-		return (-1);
+		writeTick<OUTPUT>(req, record);
 	}
 
-	// @TODO @BADCODE @CLEANUP
-	// Really bad pattern of littering file management all over the place
-	// Make new class or data structure for this
-	std::string makeFileName(std::string datetime) {
-		std::string file_name;
-		file_name = d_security.replace(d_security.begin(), d_security.end(), ' ', '-');
-		file_name += "_";
-		file_name += datetime.substr(0, 10);
-		file_name += ".csv";
-		return file_name;
-	}
+	// Output policies, one per -o, codes and -b combination: FILES if it
+	// writes tick files, and sink() for req's open one
+	template <bool CODES>
+	struct CsvOutput {
+		enum { FILES = 1 };
+		typedef CsvTickSink<CODES> Sink;
+		static Sink sink(IntradayTick &self, SecurityRequest &req)
+		{
+			return Sink(req.csv_file, &self.d_types);
+		}
+	};
+
+	template <bool CODES>
+	struct BinOutput {
+		enum { FILES = 1 };
+		typedef BinTickSink<CODES> Sink;
+		static Sink sink(IntradayTick &, SecurityRequest &req)
+		{
+			return Sink(req.bin_file);
+		}
+	};
+
+	struct NullOutput {
+		enum { FILES = 0 };
+		typedef NullSink Sink;
+		static Sink sink(IntradayTick &, SecurityRequest &)
+		{
+			return Sink();
+		}
+	};
+
+	struct BarWriter {
+		IntradayTick			*self;
+		SecurityRequest			*req;
+
+		void operator()(int type, const Bar &bar) const
+		{
+			self->writeBar(*req, type, bar);
+		}
+	};
+
+	template <typename OUTPUT>
+	struct WithBars {
+		enum { FILES = OUTPUT::FILES };
+		typedef TeeSink<typename OUTPUT::Sink, BarTickSink<BarWriter> > Sink;
+		static Sink sink(IntradayTick &self, SecurityRequest &req)
+		{
+			BarWriter out = { &self, &req };
+			return tee(OUTPUT::sink(self, req), BarTickSink<BarWriter>(&req.bars, out));
+		}
+	};
 
-	void loadCSV() {
-		csv_file.open(makeFileName(d_startDateTime), std::ios_base::app);
+	// Publishes to -sm too
+	template <typename OUTPUT>
+	struct WithPublisher {
+		enum { FILES = OUTPUT::FILES };
+		typedef TeeSink<typename OUTPUT::Sink, SharedTickSink> Sink;
+		static Sink sink(IntradayTick &self, SecurityRequest &req)
+		{
+			return tee(OUTPUT::sink(self, req), SharedTickSink(&self.d_publisher,
+				(uint32_t)self.securityIndex(req), &req.security));
+		}
+	};
+
+	template <typename OUTPUT>
+	void writeTick(SecurityRequest &req, const TickRecord &record)
+	{
+		if (OUTPUT::FILES) {
+			long long day = timeutil::dayNumber(record.time);
+			if (dateChanged(req, day) || fileEvicted(req)) {
+				reloadFile(req, day);
+			}
+		}
+		if (record.time > req.last_tick) {
+			req.last_tick = record.time;
+		}
+
+		typename OUTPUT::Sink sink = OUTPUT::sink(*this, req);
+		size_t bytes = sink(record);
+		ThreadMetrics &metrics = d_metrics.local();
+		metrics.add(COUNT_TICKS_WRITTEN, 1);
+		metrics.add(COUNT_BYTES_WRITTEN, bytes);
 	}
 
-	void reloadCSV(std::string item_date) {
-		csv_file.close();
-		current_processed_date = item_date;
-		csv_file.open(makeFileName(current_processed_date), std::ios_base::app);
+	// The writer's instantiation for the output options, picked once
+	template <typename OUTPUT>
+	void useOutput()
+	{
+		d_drainRings = &IntradayTick::drainRingsTo<OUTPUT>;
+		d_flushRequest = &IntradayTick::flushRequest<OUTPUT>;
 	}
 
-	// If the date has changed, return true
-	bool dateChanged(std::string item_date) {
-		return item_date[9] != current_processed_date[9];
+	template <typename OUTPUT>
+	void useOutputAndPublisher()
+	{
+		if (!d_publishName.empty()) {
+			useOutput<WithPublisher<OUTPUT> >();
+		}
+		else {
+			useOutput<OUTPUT>();
+		}
 	}
 
-	void unloadCSV() {
-		csv_file.close();
+	template <typename OUTPUT>
+	void useOutputAndBars()
+	{
+		if (d_barSeconds) {
+			useOutputAndPublisher<WithBars<OUTPUT> >();
+		}
+		else {
+			useOutputAndPublisher<OUTPUT>();
+		}
 	}
 
-	// For interactive 
-	void setConfig()
+	void selectOutput()
 	{
-		if (!d_security_assigned) {
-			setSecurity();
+		bool codes = d_conditionCodes || d_exchangeCodes;
+		if (d_nullOutput) {
+			useOutputAndBars<NullOutput>();
 		}
-		if (!d_startDateTime_assigned) {
-			setStartDateTime();
+		else if (d_binary) {
+			if (codes) {
+				useOutputAndBars<BinOutput<true> >();
+			}
+			else {
+				useOutputAndBars<BinOutput<false> >();
+			}
 		}
-		if (!d_endDateTime_assigned) {
-			setEndDateTime();
+		else if (codes) {
+			useOutputAndBars<CsvOutput<true> >();
+		}
+		else {
+			useOutputAndBars<CsvOutput<false> >();
 		}
 	}
 
-	void setSecurity()
+	void writeBar(SecurityRequest &req, int type, const Bar &bar)
 	{
-		std::string x;
-		std::cout << "Provide ticker: ";
-		std::getline(std::cin, x);
-		d_security = x;
+		long long day = timeutil::dayNumber(bar.start);
+		std::string file_name = makeBarFileName(req.security, day);
+
+		// Cut back to the last checkpoint, as reloadFile does for ticks
+		if (req.manifest.isOpen() && day > req.bar_truncated_day) {
+			long long bytes = req.manifest.entry(day).barBytes;
+			if (!truncateFile(file_name, bytes > 0 ? bytes : 0)) {
+				d_log.error() << "Failed to truncate " << file_name;
+			}
+			req.bar_truncated_day = day;
+		}
+
+		CsvSink *sink = d_barFiles.acquire(securityIndex(req), day, file_name);
+		if (!sink) {
+			d_log.error() << "Failed to open " << file_name;
+			return;
+		}
+		char row[csv::MAX_ROW];
+		size_t len = csv::formatBarRow(row, bar.start, tickTypeName(type),
+			bar.open, bar.high, bar.low, bar.close, bar.volume, bar.ticks);
+		sink->write(row, len);
 	}
 
-	void setStartDateTime()
+	void flushBarsBefore(SecurityRequest &req, long long time)
 	{
-		std::string x;
-		std::cout << "Provide start date: ";
-		std::getline(std::cin, x);
-		d_startDateTime = x;
+		auto out = [&](int type, const Bar &bar) {
+			writeBar(req, type, bar);
+		};
+		req.bars.flushBefore(time, out);
 	}
 
-	void setEndDateTime()
+	void flushBars(SecurityRequest &req)
 	{
-		std::string x;
-		std::cout << "Provide end date: ";
-		std::getline(std::cin, x);
-		d_endDateTime = x;
+		auto out = [&](int type, const Bar &bar) {
+			writeBar(req, type, bar);
+		};
+		req.bars.flush(out);
 	}
 
-public:
-
-	IntradayTick()
+	// Live ticks wait for the backfill of their security; those it covers
+	// are dropped
+	template <typename OUTPUT>
+	void writeLiveTick(const TickRecord &record)
 	{
-		d_host = "localhost";
-		d_port = 8194;
-		d_security_assigned = false;
-		d_startDateTime_assigned = false;
-		d_endDateTime_assigned = false;
+		if (record.time < d_liveFrom) {
+			return;
+		}
+		SecurityRequest &req = d_requests[record.chunk];
+		if (req.backfilled) {
+			writeTick<OUTPUT>(req, record);
+			req.live_written = true;
+		}
+		else {
+			req.live_buffered.push_back(record);
+			holdTicks(1);
+		}
+	}
+
+	template <typename OUTPUT>
+	void flushLiveTicks(SecurityRequest &req)
+	{
+		for (size_t i = 0; i < req.live_buffered.size(); ++i) {
+			writeTick<OUTPUT>(req, req.live_buffered[i]);
+		}
+		req.live_written |= !req.live_buffered.empty();
+		releaseTicks(req.live_buffered.size());
+		std::vector<TickRecord>().swap(req.live_buffered);
+	}
+
+	// Ticks kept in memory until earlier ones are written; writer side
+	void holdTicks(size_t count)
+	{
+		d_heldTicks.store(d_heldTicks.load(std::memory_order_relaxed) + count,
+			std::memory_order_relaxed);
+	}
+
+	void releaseTicks(size_t count)
+	{
+		d_heldTicks.store(d_heldTicks.load(std::memory_order_relaxed) - count,
+			std::memory_order_relaxed);
+	}
+
+	// Live ticks reach the CSV files within a second or so, flushing only
+	// the files live ticks went to. Bin files are left to end their blocks
+	// at full size or on closing, as during the backfill, rather than
+	// become a block a second.
+	void flushLiveFiles()
+	{
+		if (!d_live) {
+			return;
+		}
+		long long now = nowMicros();
+		if (now - d_lastLiveFlush < 1000000) {
+			return;
+		}
+		d_lastLiveFlush = now;
+		if (d_barSeconds) {
+			// Live ticks still in the rings are at most this old
+			long long settled = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count()
+				- timeutil::NANOS_PER_SECOND;
+			for (size_t i = 0; i < d_requests.size(); ++i) {
+				if (d_requests[i].backfilled) {
+					flushBarsBefore(d_requests[i], settled);
+				}
+			}
+			d_barFiles.flushAll();
+		}
+		for (size_t i = 0; i < d_requests.size(); ++i) {
+			SecurityRequest &req = d_requests[i];
+			if (!req.live_written) {
+				continue;
+			}
+			req.live_written = false;
+			CsvSink *file = d_binary ? NULL : d_csvFiles.find(i, req.current_day);
+			if (file) {
+				file->flush();
+			}
+		}
+	}
+
+	// Returns the number of records written
+	size_t drainRings()
+	{
+		return (this->*d_drainRings)();
+	}
+
+	template <typename OUTPUT>
+	size_t drainRingsTo()
+	{
+		size_t depth = 0;
+		for (size_t i = 0; i < d_rings.size(); ++i) {
+			depth += d_rings[i]->size();
+		}
+		if (depth == 0) {
+			return 0;
+		}
+
+		long long start = nowMicros();
+		size_t count = 0;
+		TickRecord record;
+		for (size_t i = 0; i < d_rings.size(); ++i) {
+			while (d_rings[i]->tryPop(&record)) {
+				writeRecord<OUTPUT>(record);
+				++count;
+			}
+		}
+		ThreadMetrics &metrics = d_metrics.local();
+		metrics.record(HIST_RING_DEPTH, depth);
+		metrics.record(HIST_WRITE, nowMicros() - start);
+		return count;
+	}
+
+	void writerLoop()
+	{
+		int idle = 0;
+		for (;;) {
+			d_writerPasses.fetch_add(1);
+			if (drainRings()) {
+				idle = 0;
+				continue;
+			}
+			if (d_producersDone.load(std::memory_order_acquire)) {
+				// Anything pushed before the flag was raised is visible now
+				if (!drainRings()) {
+					break;
+				}
+				continue;
+			}
+			flushLiveFiles();
+			if (++idle < 64) {
+				std::this_thread::yield();
+			}
+			else {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		}
+	}
+
+	void createRings(size_t count)
+	{
+		for (size_t i = 0; i < count; ++i) {
+			d_rings.push_back(new TickRing(d_ringCapacity));
+			d_arenas.push_back(new Arena);
+			d_typeCaches.push_back(InternCache(&d_types, TICK_UNKNOWN));
+			d_conditionCaches.push_back(InternCache(&d_codes, CODE_OVERFLOW_ID));
+			d_exchangeCaches.push_back(InternCache(&d_codes, CODE_OVERFLOW_ID));
+		}
+	}
+
+	void printFileUsage()
+	{
+		d_log.info() << "Output files opened: "
+			<< (d_binary ? d_binFiles.opens() : d_csvFiles.opens())
+			<< ", closed early to stay within " << d_maxOpenFiles << ": "
+			<< (d_binary ? d_binFiles.evictions() : d_csvFiles.evictions());
+	}
+
+	void printRingUsage()
+	{
+		for (size_t i = 0; i < d_rings.size(); ++i) {
+			d_log.info() << "Tick ring " << i << " high-water mark: "
+				<< d_rings[i]->highWaterMark() << " of "
+				<< d_rings[i]->capacity();
+			if (d_arenas[i]->capacity()) {
+				d_log.info() << "Decode arena " << i << " high-water mark: "
+					<< d_arenas[i]->highWaterMark() << " of "
+					<< d_arenas[i]->capacity() << " bytes";
+			}
+		}
+	}
+
+	// Write out chunks, in order, as soon as everything before them is done
+	template <typename OUTPUT>
+	void advanceChunks(SecurityRequest &req)
+	{
+		while (req.next_chunk < req.num_chunks) {
+			TickChunk &chunk = d_chunks[req.first_chunk + req.next_chunk];
+			flushChunk<OUTPUT>(req, chunk);
+			if (!chunk.complete) {
+				// Now the head; the rest of it streams straight to file
+				return;
+			}
+			checkpoint(req, chunk);
+			++req.next_chunk;
+		}
+		if (d_live) {
+			// Files stay open for the live ticks that follow
+			req.backfilled = true;
+			flushLiveTicks<OUTPUT>(req);
+		}
+		else {
+			unloadFile(req);
+		}
+	}
+
+	// Everything up to the end of chunk is on disk; note that in the
+	// manifest unless this or an earlier chunk of the security failed
+	void checkpoint(SecurityRequest &req, const TickChunk &chunk)
+	{
+		if (chunk.failed) {
+			req.checkpoints = false;
+		}
+		if (!req.checkpoints || !req.manifest.isOpen()) {
+			return;
+		}
+
+		// The last window keeps its inclusive end
+		long long resume = chunk.last ? chunk.window.end + 1 : chunk.window.end;
+		long long day = timeutil::floorDay(resume - 1) / timeutil::SECONDS_PER_DAY;
+
+		ManifestEntry entry = req.manifest.entry(day);
+		entry.resumeFrom = resume;
+		if (req.current_day == day) {
+			entry.bytes = writtenBytes(req, day);
+		}
+		if (req.last_tick >= 0 && timeutil::dayNumber(req.last_tick) == day) {
+			entry.lastTick = req.last_tick;
+		}
+		entry.barBytes = -1;
+		if (d_barSeconds) {
+			// Bars ending by the resume point are final; those still open
+			// are rebuilt by the next run
+			flushBarsBefore(req, resume * timeutil::NANOS_PER_SECOND);
+			entry.barBytes = writtenBarBytes(req, day);
+		}
+		req.manifest.record(entry);
+	}
+
+	template <typename OUTPUT>
+	void flushChunk(SecurityRequest &req, TickChunk &chunk)
+	{
+		for (size_t i = 0; i < chunk.buffered.size(); ++i) {
+			writeTick<OUTPUT>(req, chunk.buffered[i]);
+		}
+		releaseTicks(chunk.buffered.size());
+		std::vector<TickRecord>().swap(chunk.buffered);
+	}
+
+	void printFailedChunks()
+	{
+		for (size_t i = 0; i < d_chunks.size(); ++i) {
+			const TickChunk &chunk = d_chunks[i];
+			if (chunk.failed || !chunk.complete) {
+				d_log.warn() << (chunk.failed ? "FAILED WINDOW: " : "INCOMPLETE WINDOW: ")
+					<< d_requests[chunk.security].security
+					<< " " << timeutil::formatDateTime(chunk.window.start)
+					<< " " << timeutil::formatDateTime(chunk.window.end);
+			}
+		}
+	}
+
+	// Narrow the chunk to what has not been received yet. Writer side, or
+	// with the writer stopped.
+	void rewindChunk(TickChunk &chunk)
+	{
+		if (chunk.last_second_ticks > 0) {
+			chunk.window.start = chunk.last_second;
+			chunk.skip = chunk.last_second_ticks;
+		}
+	}
+
+	static long long retryDelayMicros(int attempt)
+	{
+		int shift = attempt < 1 ? 0 : (attempt > 7 ? 6 : attempt - 1);
+		return (1LL << shift) * 1000000;
+	}
+
+	static bool isRetriable(const char *category)
+	{
+		return !std::strcmp(category, "LIMIT") || !std::strcmp(category, "TIMEOUT")
+			|| !std::strcmp(category, "INTERNAL_ERROR") || !std::strcmp(category, "CANCELED");
+	}
+
+	// Decided on the receiving side, where the error is seen; the writer
+	// queues the retry once it has taken every tick before the failure
+	bool retryAllowed(unsigned chunk, const char *category, bool requestFailure)
+	{
+		std::lock_guard<std::mutex> lock(d_scheduleMutex);
+		TickChunk &c = d_chunks[chunk];
+		if ((!requestFailure && !isRetriable(category)) || c.attempts >= d_maxRetries) {
+			return false;
+		}
+		++c.attempts;
+		++d_pendingRetries;
+		return true;
+	}
+
+	void scheduleRetry(unsigned chunk)
+	{
+		std::lock_guard<std::mutex> lock(d_scheduleMutex);
+		TickChunk &c = d_chunks[chunk];
+		long long delay = retryDelayMicros(c.attempts);
+		c.not_before = nowMicros() + delay;
+		d_retries.push_back(chunk);
+		--d_pendingRetries;
+		d_log.info() << d_requests[c.security].security << ": retrying from "
+			<< timeutil::formatDateTime(c.window.start) << " in " << delay / 1000000
+			<< "s (attempt " << c.attempts << " of " << d_maxRetries << ")";
+	}
+
+	// Async mode: returns once the writer has taken every record pushed
+	// so far, i.e. a whole pass has begun and ended since the call
+	void waitForWriter()
+	{
+		unsigned long long start = d_writerPasses.load();
+		while (d_writerPasses.load() < start + 2) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	// Queue again, at the front of its own queue, whatever the endpoint's
+	// ended session still owed; false when out of restarts or nothing is
+	// left. Its session and dispatcher must be stopped.
+	bool restartSession(Endpoint &e, int restarts)
+	{
+		if (d_async && !d_producersDone.load()) {
+			// The writer may still be taking the ticks rewindChunk cuts at
+			waitForWriter();
+		}
+		long long delay;
+		{
+			std::lock_guard<std::mutex> lock(d_scheduleMutex);
+			for (size_t i = d_chunks.size(); i-- > 0; ) {
+				TickChunk &chunk = d_chunks[i];
+				if (chunk.in_flight && chunk.endpoint == e.index) {
+					chunk.in_flight = false;
+					rewindChunk(chunk);
+					d_queued.pushFront(e.index, i);
+				}
+			}
+			e.scheduler.abandonInFlight();
+			if (d_queued.empty() && d_retries.empty() && !(e.index == 0 && liveRunning())
+				&& !daemonRunning()) {
+				return false;
+			}
+			if (restarts >= d_maxRetries) {
+				d_log.error() << "Session to " << e.host << ":" << e.port
+					<< " ended; giving up after " << restarts << " restart(s)";
+				return false;
+			}
+			delay = retryDelayMicros(restarts + 1);
+		}
+		d_log.warn() << "Session to " << e.host << ":" << e.port << " ended; restarting in "
+			<< delay / 1000000 << "s";
+		std::this_thread::sleep_for(std::chrono::microseconds(delay));
+		return true;
+	}
+
+	// Returns true once every request has received its final response
+	bool processResponseEvent(const Event &event, size_t slot)
+	{
+		bool done = false;
+		std::unique_lock<std::mutex> shared(d_sharedRingMutex, std::defer_lock);
+		if (slot + 1 == d_rings.size()) {
+			shared.lock();
+		}
+		TickRing &ring = *d_rings[slot];
+		ArenaScope scratch(*d_arenas[slot]);
+		ArenaArray<TickRecord> captured(d_arenas[slot]);
+		ThreadMetrics &metrics = d_metrics.local();
+		long long decodeMicros = 0;
+		metrics.add(COUNT_EVENTS, 1);
+
+		MessageIterator msgIter(event);
+		while (msgIter.next()) {
+			Message msg = msgIter.message();
+			long long index = findChunk(msg);
+			if (index < 0) {
+				continue;
+			}
+
+			unsigned chunk = (unsigned)index;
+			unsigned flags = 0;
+			const char *category = "";
+			const char *message = "";
+			size_t ticks = 0;
+			captured.clear();
+			responseArrived(chunk);
+			// The session gave up on the request, e.g. on losing its connection
+			bool requestFailure = msg.messageType() == REQUEST_FAILURE;
+			bool final = event.eventType() == Event::RESPONSE || requestFailure;
+			if (requestFailure) {
+				category = "UNCLASSIFIED";
+				if (msg.hasElement(REASON) && msg.getElement(REASON).hasElement(CATEGORY)) {
+					category = msg.getElement(REASON).getElementAsString(CATEGORY);
+				}
+				d_log.warn() << d_requests[d_chunks[chunk].security].security
+					<< ": REQUEST FAILED: " << category;
+				flags |= TICK_REQUEST_FAILED;
+			}
+			else if (msg.hasElement(RESPONSE_ERROR)) {
+				Element error = msg.getElement(RESPONSE_ERROR);
+				LogLine out = d_log.warn();
+				out << d_requests[d_chunks[chunk].security].security << ": ";
+				printErrorInfo(out, "REQUEST FAILED: ", error);
+				category = error.getElementAsString(CATEGORY);
+				message = error.getElementAsString(MESSAGE);
+				flags |= TICK_REQUEST_FAILED;
+			}
+			else {
+				long long start = nowMicros();
+				ticks = processMessage(msg, chunk, slot, d_capture.isOpen() ? &captured : NULL);
+				decodeMicros += nowMicros() - start;
+			}
+			if (final) {
+				flags |= TICK_END_OF_REQUEST;
+				if ((flags & TICK_REQUEST_FAILED) && retryAllowed(chunk, category, requestFailure)) {
+					flags = TICK_REQUEST_RETRIED;
+				}
+			}
+			if (d_capture.isOpen()) {
+				std::lock_guard<std::mutex> lock(d_captureMutex);
+				d_capture.writeMessage(chunk, flags, captured.data(), captured.size(),
+					category, message);
+			}
+			endMessage(chunk, flags, ticks, ring);
+
+			// Final message of this request, free its slot for the next one
+			if (final) {
+				done = requestDone(chunk, category);
+			}
+		}
+		metrics.record(HIST_DECODE, decodeMicros);
+		return done;
+	}
+
+	long long findChunk(const Message &msg)
+	{
+		CorrelationId cid = msg.correlationId();
+		if (cid.valueType() != CorrelationId::INT_VALUE) {
+			return -1;
+		}
+		long long index = cid.asInteger();
+		if (index < 0 || index >= (long long)d_chunks.size()) {
+			return -1;
+		}
+		return index;
+	}
+
+	static long long nowMicros()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Time to first response is what the scheduler adapts concurrency to
+	void responseArrived(unsigned chunk)
+	{
+		std::lock_guard<std::mutex> lock(d_scheduleMutex);
+		TickChunk &c = d_chunks[chunk];
+		if (!c.answered) {
+			c.answered = true;
+			long long latency = nowMicros() - c.sent_micros;
+			d_endpoints[c.endpoint]->scheduler.onFirstResponse(latency / 1e6);
+			d_metrics.local().record(HIST_FIRST_RESPONSE, latency);
+		}
+	}
+
+	// category is the responseError category, empty on success. The slot
+	// freed goes to the next request for the same session.
+	bool requestDone(unsigned chunk, const char *category)
+	{
+		std::lock_guard<std::mutex> lock(d_scheduleMutex);
+		TickChunk &c = d_chunks[chunk];
+		c.in_flight = false;
+		Endpoint &e = *d_endpoints[c.endpoint];
+		e.scheduler.onComplete(category, nowMicros());
+		if (e.session) {
+			sendQueuedRequests(e);
+		}
+		return backfillDone();
+	}
+
+	// Caller holds d_scheduleMutex
+	bool backfillDone()
+	{
+		for (size_t i = 0; i < d_endpoints.size(); ++i) {
+			if (d_endpoints[i]->scheduler.inFlight() != 0) {
+				return false;
+			}
+		}
+		return d_queued.empty() && d_retries.empty() && d_pendingRetries == 0;
+	}
+
+	bool liveRunning()
+	{
+		return d_live && time(0) < d_liveEnd;
+	}
+
+	// -d: the sessions stay up, with or without a job
+	bool daemonRunning()
+	{
+		return d_jobs.isOpen() && !d_stopping.load();
+	}
+
+	void subscribeLive(Session &session)
+	{
+		if (d_liveSubscribed) {
+			d_log.warn() << "Live ticks since the session ended are missing";
+		}
+		else if ((long long)time(0) * timeutil::NANOS_PER_SECOND > d_liveFrom) {
+			d_log.warn() << "Live ticks from "
+				<< timeutil::formatDateTime(d_liveFrom / timeutil::NANOS_PER_SECOND)
+				<< " until now are missing";
+		}
+		d_liveSubscribed = true;
+		SubscriptionList subscriptions;
+		for (size_t s = 0; s < d_requests.size(); ++s) {
+			subscriptions.add(d_requests[s].security.c_str(), MKTDATA_FIELDS, "",
+				CorrelationId((long long)s, LIVE_CLASS_ID));
+		}
+		session.subscribe(subscriptions);
+	}
+
+	// Same hand-off to the writer as processResponseEvent
+	void processSubscriptionEvent(const Event &event, size_t slot)
+	{
+		std::unique_lock<std::mutex> shared(d_sharedRingMutex, std::defer_lock);
+		if (slot + 1 == d_rings.size()) {
+			shared.lock();
+		}
+		TickRing &ring = *d_rings[slot];
+		ThreadMetrics &metrics = d_metrics.local();
+		long long start = nowMicros();
+		metrics.add(COUNT_EVENTS, 1);
+
+		TickRecord record = TickRecord();
+		record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		record.flags = TICK_STREAMED;
+		auto out = [&](const TickRecord &tick) {
+			pushRecord(ring, tick);
+		};
+
+		MessageIterator msgIter(event);
+		while (msgIter.next()) {
+			Message msg = msgIter.message();
+			const CorrelationId &cid = msg.correlationId();
+			if (cid.classId() != LIVE_CLASS_ID
+				|| (size_t)cid.asInteger() >= d_requests.size()) {
+				continue;
+			}
+			record.chunk = (unsigned)cid.asInteger();
+			metrics.add(COUNT_TICKS_DECODED, decodeMarketData(msg.asElement(), record, d_liveTypes, out));
+			metrics.add(COUNT_MESSAGES, 1);
+		}
+		if (!d_async) {
+			drainRings();
+		}
+		metrics.record(HIST_DECODE, nowMicros() - start);
+	}
+
+	void processSubscriptionStatus(const Event &event)
+	{
+		MessageIterator msgIter(event);
+		while (msgIter.next()) {
+			Message msg = msgIter.message();
+			const CorrelationId &cid = msg.correlationId();
+			if (cid.classId() != LIVE_CLASS_ID
+				|| (size_t)cid.asInteger() >= d_requests.size()) {
+				continue;
+			}
+			if (msg.messageType() == SUBSCRIPTION_FAILURE
+				|| msg.messageType() == SUBSCRIPTION_TERMINATED) {
+				d_log.warn() << d_requests[(size_t)cid.asInteger()].security
+					<< ": " << msg.messageType().string() << ", no live ticks";
+			}
+		}
+	}
+
+	// Send the endpoint's queued requests, or failing those anyone's, for
+	// as long as its scheduler allows. Caller holds d_scheduleMutex.
+	void sendQueuedRequests(Endpoint &e)
+	{
+		long long now = nowMicros();
+
+		// Retries whose backoff is over go ahead of everything else
+		for (size_t i = 0; i < d_retries.size(); ) {
+			if (d_chunks[d_retries[i]].not_before <= now) {
+				d_queued.pushFront(e.index, d_retries[i]);
+				d_retries.erase(d_retries.begin() + i);
+			}
+			else {
+				++i;
+			}
+		}
+
+		size_t index;
+		while (d_queued.hasWork(e.index) && e.scheduler.canSend(now)) {
+			// Unless nothing is in flight anywhere, so that the requests
+			// the writer waits on still go out
+			if (writerBehind(now) && requestsInFlight() > 0) {
+				break;
+			}
+			d_queued.pop(e.index, &index);
+			d_chunks[index].endpoint = e.index;
+			d_chunks[index].sent_micros = now;
+			d_chunks[index].answered = false;
+			d_chunks[index].in_flight = true;
+			d_chunks[index].boundary.valid = false;
+			++d_chunks[index].sends;
+			sendIntradayTickRequest(*e.session, index);
+			e.scheduler.onSend();
+			d_metrics.local().add(COUNT_REQUESTS, 1);
+		}
+	}
+
+	// Backpressure, with some slack either way so that sending does not
+	// stop and start on every tick. Caller holds d_scheduleMutex.
+	bool writerBehind(long long now)
+	{
+		if (d_maxBufferMB <= 0) {
+			return false;
+		}
+		size_t depth = 0, capacity = 0;
+		for (size_t i = 0; i < d_rings.size(); ++i) {
+			depth += d_rings[i]->sizeFromAnyThread();
+			capacity += d_rings[i]->capacity();
+		}
+		const size_t limit = (size_t)d_maxBufferMB * 1024 * 1024 / sizeof(TickRecord);
+		const size_t held = d_heldTicks.load(std::memory_order_relaxed);
+		if (!d_holding && (held >= limit || depth >= capacity / 4 * 3)) {
+			d_holding = true;
+			d_holdStart = now;
+			d_metrics.local().add(COUNT_SEND_HOLDS, 1);
+			d_log.debug() << "Holding requests back: " << held << " ticks held, "
+				<< depth << " in the rings";
+		}
+		else if (d_holding && held <= limit / 2 && depth <= capacity / 4) {
+			d_holding = false;
+			d_metrics.local().add(COUNT_SEND_HELD_MICROS, now - d_holdStart);
+		}
+		return d_holding;
+	}
+
+	// Caller holds d_scheduleMutex
+	int requestsInFlight()
+	{
+		int inFlight = 0;
+		for (size_t i = 0; i < d_endpoints.size(); ++i) {
+			inFlight += d_endpoints[i]->scheduler.inFlight();
+		}
+		return inFlight;
+	}
+
+	// Microseconds until the rate limit lets the endpoint's next request
+	// go or a retry's backoff is over, 0 if nothing is waiting on either
+	long long pacingWait(Endpoint &e)
+	{
+		std::lock_guard<std::mutex> lock(d_scheduleMutex);
+		long long now = nowMicros();
+		long long wait = 0;
+		if (d_queued.hasWork(e.index) && e.scheduler.inFlight() < e.scheduler.limit()) {
+			wait = e.scheduler.waitMicros(now);
+		}
+		for (size_t i = 0; i < d_retries.size(); ++i) {
+			long long due = d_chunks[d_retries[i]].not_before - now;
+			if (due < 1) {
+				due = 1;
+			}
+			if (wait == 0 || due < wait) {
+				wait = due;
+			}
+		}
+		return wait;
+	}
+
+	void maybePrintMetrics()
+	{
+		if (d_metricsInterval > 0 && d_log.enabled(LOG_INFO)
+			&& nowMicros() - d_lastReport >= d_metricsInterval * 1000000LL) {
+			printMetrics();
+		}
+	}
+
+	void printHistogram(LogLine &out, const char *name, const char *unit, MetricsHistogram h)
+	{
+		HistogramSnapshot snapshot;
+		d_metrics.histogram(h, &snapshot);
+		out << '\n' << "  " << std::left << std::setw(16) << name << std::right
+			<< std::setw(8) << unit
+			<< " p50 " << std::setw(8) << snapshot.percentile(0.50)
+			<< " p90 " << std::setw(8) << snapshot.percentile(0.90)
+			<< " p99 " << std::setw(8) << snapshot.percentile(0.99)
+			<< " max " << std::setw(8) << snapshot.max
+			<< " n " << snapshot.total;
+	}
+
+	// Totals since start, rates since the previous report
+	void printMetrics()
+	{
+		long long now = nowMicros();
+		double sinceLast = (now - d_lastReport) / 1e6;
+		uint64_t ticks = d_metrics.counter(COUNT_TICKS_WRITTEN);
+		uint64_t bytes = d_metrics.counter(COUNT_BYTES_WRITTEN);
+		int queued, inFlight, limit;
+		uint64_t heldMicros = d_metrics.counter(COUNT_SEND_HELD_MICROS);
+		{
+			std::lock_guard<std::mutex> lock(d_scheduleMutex);
+			queued = (int)(d_queued.size() + d_retries.size());
+			inFlight = requestsInFlight();
+			limit = 0;
+			for (size_t i = 0; i < d_endpoints.size(); ++i) {
+				limit += d_endpoints[i]->scheduler.limit();
+			}
+			if (d_holding) {
+				heldMicros += now - d_holdStart;
+			}
+		}
+
+		LogLine out = d_log.info();
+		out << "--- metrics at " << std::fixed << std::setprecision(1)
+			<< (now - d_startMicros) / 1e6 << "s ---" << '\n'
+			<< "  events " << d_metrics.counter(COUNT_EVENTS)
+			<< ", messages " << d_metrics.counter(COUNT_MESSAGES)
+			<< ", ticks decoded " << d_metrics.counter(COUNT_TICKS_DECODED)
+			<< ", written " << ticks
+			<< " (" << (sinceLast > 0 ? (ticks - d_lastTicks) / sinceLast : 0.0) << "/s)"
+			<< ", MB written " << bytes / 1e6
+			<< " (" << (sinceLast > 0 ? (bytes - d_lastBytes) / 1e6 / sinceLast : 0.0) << "/s)" << '\n'
+			<< "  requests sent " << d_metrics.counter(COUNT_REQUESTS)
+			<< ", waiting " << queued
+			<< ", in flight " << inFlight << " of " << limit << '\n'
+			<< "  requests held back " << d_metrics.counter(COUNT_SEND_HOLDS)
+			<< " times for " << heldMicros / 1e6 << "s"
+			<< ", decoding waited on full rings " << d_metrics.counter(COUNT_RING_FULL_MICROS) / 1e6 << "s"
+			<< ", ticks held " << d_heldTicks.load(std::memory_order_relaxed);
+		if (d_validate) {
+			out << '\n'
+				<< "  ticks reordered " << d_metrics.counter(COUNT_TICKS_UNORDERED)
+				<< ", dropped invalid " << d_metrics.counter(COUNT_TICKS_INVALID)
+				<< ", stale " << d_metrics.counter(COUNT_TICKS_STALE)
+				<< ", duplicate " << d_metrics.counter(COUNT_TICKS_DUPLICATE);
+		}
+		out << std::defaultfloat << std::setprecision(6);
+		printHistogram(out, "first response", "us", HIST_FIRST_RESPONSE);
+		printHistogram(out, "event wait", "us", HIST_EVENT_WAIT);
+		printHistogram(out, "decode/event", "us", HIST_DECODE);
+		printHistogram(out, "write/pass", "us", HIST_WRITE);
+		printHistogram(out, "ring depth", "records", HIST_RING_DEPTH);
+
+		d_lastReport = now;
+		d_lastTicks = ticks;
+		d_lastBytes = bytes;
+	}
+
+	void printSchedulerUsage()
+	{
+		for (size_t i = 0; i < d_endpoints.size(); ++i) {
+			const Endpoint &e = *d_endpoints[i];
+			if (e.scheduler.sent() == 0) {
+				continue;
+			}
+			LogLine out = d_log.info();
+			out << "Requests sent";
+			if (d_endpoints.size() > 1) {
+				out << " to " << e.host << ":" << e.port;
+			}
+			out << ": " << e.scheduler.sent()
+				<< ", throttled: " << e.scheduler.throttled()
+				<< ", concurrency " << e.scheduler.limit() << " of " << d_maxInFlight
+				<< " (lowest " << e.scheduler.lowestLimit() << ")";
+		}
+		if (d_endpoints.size() > 1) {
+			d_log.info() << "Requests taken from another session's queue: " << d_queued.stolen();
+		}
+	}
+
+	void sendIntradayTickRequest(Session &session, size_t index)
+	{
+		Service refDataService = session.getService("//blp/refdata");
+		Request request = refDataService.createRequest("IntradayTickRequest");
+
+		const TickChunk &chunk = d_chunks[index];
+
+		// Only one security per request
+		request.set("security", d_requests[chunk.security].security.c_str());
+
+		// Add fields to request
+		Element eventTypes = request.getElement("eventTypes");
+
+		for (size_t i = 0; i < d_events.size(); ++i) {
+			eventTypes.appendValue(d_events[i].c_str());
+		}
+
+		// All times are in GMT
+		request.set("startDateTime", toDatetime(chunk.window.start));
+		request.set("endDateTime", toDatetime(chunk.window.end));
+		if (d_conditionCodes) {
+			request.set("includeConditionCodes", true);
+		}
+		if (d_exchangeCodes) {
+			request.set("includeExchangeCodes", true);
+		}
+
+		d_log.debug() << "Sending Request: " << request;
+		session.sendRequest(request, CorrelationId((long long)index));
+	}
+
+	// Write the plan up front so the capture replays on its own
+	bool openCapture()
+	{
+		if (!d_capture.open(d_captureFile)) {
+			d_log.error() << "Failed to open " << d_captureFile;
+			return false;
+		}
+		for (size_t s = 0; s < d_requests.size(); ++s) {
+			const SecurityRequest &req = d_requests[s];
+			d_capture.writeSecurity(req.security, req.first_chunk, req.num_chunks);
+			for (size_t c = req.first_chunk; c < req.first_chunk + req.num_chunks; ++c) {
+				d_capture.writeChunk(c, s, d_chunks[c].window.start, d_chunks[c].window.end);
+			}
+		}
+		return true;
+	}
+
+	// Rebuild the plan from the capture and push every captured message
+	// through the writer, with no session. As in a run, -a writes on a
+	// thread of its own, here behind -dt threads that each replay whole
+	// securities, so each one's messages keep their order.
+	void runReplay()
+	{
+		CaptureReader reader;
+		if (!reader.open(d_replayFile)) {
+			d_log.error() << "Failed to open capture " << d_replayFile;
+			return;
+		}
+		if (!d_types.open(TYPES_FILE)) {
+			d_log.error() << "Failed to open " << TYPES_FILE;
+			return;
+		}
+		if (!openPublisher()) return;
+		createRings(d_async ? d_dispatcherThreads + 1 : 1);
+
+		CaptureRecord record;
+		std::atomic<size_t> messages(0), ticks(0);
+		if (d_async) {
+			// The plan is all there is to take from this pass
+			while (reader.next(&record, [](uint32_t) { return false; })) {
+				replayPlan(record);
+			}
+			replayAsync(&messages, &ticks);
+		}
+		else {
+			while (reader.next(&record)) {
+				const CaptureRecordHeader &header = record.header;
+				if (header.kind != CAPTURE_MESSAGE) {
+					replayPlan(record);
+				}
+				else if (header.chunk < d_chunks.size()) {
+					replayMessage(record, 0);
+					++messages;
+					ticks += header.count;
+					maybePrintMetrics();
+				}
+			}
+		}
+
+		finishOutput();
+		d_log.info() << "Replayed " << messages << " messages, " << ticks
+			<< " ticks from " << d_replayFile;
+	}
+
+	void replayPlan(const CaptureRecord &record)
+	{
+		const CaptureRecordHeader &header = record.header;
+		if (header.kind == CAPTURE_SECURITY) {
+			addSecurity(record.name);
+			SecurityRequest &req = d_requests.back();
+			req.first_chunk = header.chunk;
+			req.num_chunks = header.count;
+			req.next_chunk = 0;
+			if (req.first_chunk + req.num_chunks > d_chunks.size()) {
+				d_chunks.resize(req.first_chunk + req.num_chunks);
+			}
+		}
+		else if (header.kind == CAPTURE_CHUNK) {
+			if (header.chunk >= d_chunks.size() || header.count >= d_requests.size()) {
+				return;
+			}
+			const SecurityRequest &req = d_requests[header.count];
+			TickChunk &chunk = d_chunks[header.chunk];
+			chunk.security = header.count;
+			chunk.window.start = record.start;
+			chunk.window.end = record.end;
+			chunk.end_time = timeutil::formatDateTime(record.end);
+			chunk.last = header.chunk + 1 == req.first_chunk + req.num_chunks;
+		}
+	}
+
+	void replayAsync(std::atomic<size_t> *messages, std::atomic<size_t> *ticks)
+	{
+		d_producersDone = false;
+		std::thread writer(&IntradayTick::writerLoop, this);
+		std::atomic<int> running(d_dispatcherThreads);
+		std::vector<std::thread> shards;
+		for (int i = 0; i < d_dispatcherThreads; ++i) {
+			shards.push_back(std::thread([this, i, messages, ticks, &running] {
+				replayShard((size_t)i, messages, ticks);
+				--running;
+			}));
+		}
+		while (running.load() > 0) {
+			maybePrintMetrics();
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		for (size_t i = 0; i < shards.size(); ++i) {
+			shards[i].join();
+		}
+		d_producersDone.store(true, std::memory_order_release);
+		writer.join();
+	}
+
+	// Every message of the securities of one replay thread, read through a
+	// reader of its own
+	void replayShard(size_t shard, std::atomic<size_t> *messages, std::atomic<size_t> *ticks)
+	{
+		CaptureReader reader;
+		if (!reader.open(d_replayFile)) {
+			d_log.error() << "Failed to open capture " << d_replayFile;
+			return;
+		}
+		const size_t shards = (size_t)d_dispatcherThreads;
+		const size_t slot = producerSlot();
+		CaptureRecord record;
+		while (reader.next(&record, [&](uint32_t chunk) {
+			return chunk < d_chunks.size() && d_chunks[chunk].security % shards == shard;
+		})) {
+			if (record.header.kind == CAPTURE_MESSAGE) {
+				replayMessage(record, slot);
+				++*messages;
+				*ticks += record.header.count;
+			}
+		}
+	}
+
+	// Same hand-off as processResponseEvent, message by message through the
+	// same rings, markers and counts, with the ticks already decoded
+	void replayMessage(const CaptureRecord &record, size_t slot)
+	{
+		const CaptureRecordHeader &header = record.header;
+		TickRing &ring = *d_rings[slot];
+		if (d_validate) {
+			if (header.count) {
+				TickColumns batch = { header.count, &record.times[0], &record.values[0],
+					&record.sizes[0], &record.types[0], &record.conditions[0], &record.exchanges[0] };
+				ArenaScope scratch(*d_arenas[slot]);
+				pushValidated(header.chunk, batch, ring, *d_arenas[slot]);
+			}
+			if (header.flags & TICK_REQUEST_RETRIED) {
+				// What follows in the capture is the retry's
+				d_chunks[header.chunk].boundary.valid = false;
+				++d_chunks[header.chunk].sends;
+			}
+		}
+		else {
+			TickRecord tick = TickRecord();
+			tick.chunk = header.chunk;
+			for (uint32_t i = 0; i < header.count; ++i) {
+				tick.time = record.times[i];
+				tick.value = record.values[i];
+				tick.size = record.sizes[i];
+				tick.type = record.types[i];
+				tick.condition = record.conditions[i];
+				tick.exchange = record.exchanges[i];
+				pushRecord(ring, tick);
+			}
+		}
+		if (header.flags & TICK_REQUEST_FAILED) {
+			d_log.warn() << d_requests[d_chunks[header.chunk].security].security
+				<< ": REQUEST FAILED: " << record.name
+				<< " (" << record.message << ")";
+		}
+		endMessage(header.chunk, header.flags, header.count, ring);
+	}
+
+	// Returns false if the session ended before every request was answered.
+	// In a daemon it runs one job after another, up to the stop line.
+	bool eventLoop(Endpoint &e)
+	{
+		Session &session = *e.session;
+		bool done;
+		{
+			std::lock_guard<std::mutex> lock(d_scheduleMutex);
+			sendQueuedRequests(e);
+			done = backfillDone();
+		}
+
+		while (!done || liveRunning() || daemonRunning()) {
+			if (done && d_jobs.isOpen()) {
+				// Every tick of the job is written; the session waits on
+				// for the next
+				if (d_jobRunning) {
+					finishJob();
+				}
+				if (startNextJob()) {
+					std::lock_guard<std::mutex> lock(d_scheduleMutex);
+					sendQueuedRequests(e);
+					done = backfillDone();
+					continue;
+				}
+				if (d_stopping) {
+					break;
+				}
+			}
+			// Wake up for the rate limit even if nothing arrives
+			long long wait = pacingWait(e);
+			if ((d_metricsInterval > 0 || d_live || d_jobs.isOpen())
+				&& (wait == 0 || wait > 1000000)) {
+				// Wake up to report, flush, stop or look for a job even
+				// when there is nothing to do
+				wait = 1000000;
+			}
+			long long start = nowMicros();
+			Event event = session.nextEvent(wait > 0 ? (int)((wait + 999) / 1000) : 0);
+			d_metrics.local().record(HIST_EVENT_WAIT, nowMicros() - start);
+			maybePrintMetrics();
+			flushLiveFiles();
+
+			if (event.eventType() == Event::TIMEOUT) {
+				std::lock_guard<std::mutex> lock(d_scheduleMutex);
+				sendQueuedRequests(e);
+			}
+			else if (event.eventType() == Event::PARTIAL_RESPONSE) {
+				processResponseEvent(event, producerSlot());
+			}
+			else if (event.eventType() == Event::RESPONSE
+				|| event.eventType() == Event::REQUEST_STATUS) {
+				done = processResponseEvent(event, producerSlot());
+			}
+			else if (event.eventType() == Event::SUBSCRIPTION_DATA) {
+				processSubscriptionEvent(event, producerSlot());
+			}
+			else if (event.eventType() == Event::SUBSCRIPTION_STATUS) {
+				processSubscriptionStatus(event);
+			}
+			else {
+				MessageIterator msgIter(event);
+				while (msgIter.next()) {
+					Message msg = msgIter.message();
+					if (event.eventType() == Event::SESSION_STATUS) {
+						if (msg.messageType() == SESSION_TERMINATED) {
+							return false;
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	// Session ended early; keep whatever arrived in order
+	template <typename OUTPUT>
+	void flushRequest(SecurityRequest &req)
+	{
+		for (size_t c = req.next_chunk; c < req.num_chunks; ++c) {
+			flushChunk<OUTPUT>(req, d_chunks[req.first_chunk + c]);
+		}
+		flushLiveTicks<OUTPUT>(req);
+	}
+
+	void finishOutput()
+	{
+		for (size_t i = 0; i < d_requests.size(); ++i) {
+			SecurityRequest &req = d_requests[i];
+			(this->*d_flushRequest)(req);
+			unloadFile(req);
+		}
+		printFailedChunks();
+		printFileUsage();
+		if (d_publisher.isOpen()) {
+			d_log.info() << "Ticks published to " << d_publishName << ": "
+				<< d_publisher.published();
+		}
+		printSchedulerUsage();
+		printMetrics();
+	}
+
+	void saveJobOptions(JobOptions *o)
+	{
+		o->security = d_security;
+		o->securitiesFile = d_securitiesFile;
+		o->events = d_events;
+		o->startDateTime = d_startDateTime;
+		o->endDateTime = d_endDateTime;
+		o->security_assigned = d_security_assigned;
+		o->startDateTime_assigned = d_startDateTime_assigned;
+		o->endDateTime_assigned = d_endDateTime_assigned;
+		o->chunkHours = d_chunkHours;
+		o->sessionsOnly = d_sessionsOnly;
+		o->calendarFile = d_calendarFile;
+		o->maxRetries = d_maxRetries;
+		o->binary = d_binary;
+		o->nullOutput = d_nullOutput;
+		o->barSeconds = d_barSeconds;
+		o->conditionCodes = d_conditionCodes;
+		o->exchangeCodes = d_exchangeCodes;
+		o->packBlocks = d_packBlocks;
+		o->validate = d_validate;
+	}
+
+	void restoreJobOptions(const JobOptions &o)
+	{
+		d_security = o.security;
+		d_securitiesFile = o.securitiesFile;
+		d_events = o.events;
+		d_startDateTime = o.startDateTime;
+		d_endDateTime = o.endDateTime;
+		d_security_assigned = o.security_assigned;
+		d_startDateTime_assigned = o.startDateTime_assigned;
+		d_endDateTime_assigned = o.endDateTime_assigned;
+		d_chunkHours = o.chunkHours;
+		d_sessionsOnly = o.sessionsOnly;
+		d_calendarFile = o.calendarFile;
+		d_maxRetries = o.maxRetries;
+		d_binary = o.binary;
+		d_nullOutput = o.nullOutput;
+		d_barSeconds = o.barSeconds;
+		d_conditionCodes = o.conditionCodes;
+		d_exchangeCodes = o.exchangeCodes;
+		d_packBlocks = o.packBlocks;
+		d_validate = o.validate;
+	}
+
+	// Daemon: starts the next job added to the job file; false if there is
+	// none yet or it was the stop line
+	bool startNextJob()
+	{
+		std::string line;
+		while (!d_stopping && d_jobs.next(&line)) {
+			if (line == "stop") {
+				d_log.info() << "Stopping at the stop line of " << d_jobs.path();
+				d_stopping = true;
+			}
+			else if (startJob(line)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Plans the job straight onto the sessions' queues; false if it is bad
+	// or already written. No request of the previous job may be left, and
+	// in async mode the writer must be stopped.
+	bool startJob(const std::string &line)
+	{
+		std::vector<std::string> words;
+		if (!splitJobLine(line, &words)) {
+			d_log.error() << "Unclosed quote in job: " << line;
+			return false;
+		}
+		bool events = false, securities = false;
+		for (size_t i = 0; i < words.size(); ++i) {
+			size_t o = 0;
+			while (o < sizeof(JOB_OPTIONS) / sizeof(JOB_OPTIONS[0]) && words[i] != JOB_OPTIONS[o].name) {
+				++o;
+			}
+			if (o == sizeof(JOB_OPTIONS) / sizeof(JOB_OPTIONS[0])) {
+				d_log.error() << words[i] << " is not a job option: " << line;
+				return false;
+			}
+			events |= words[i] == "-e";
+			securities |= words[i] == "-s" || words[i] == "-f";
+			i += JOB_OPTIONS[o].value;
+		}
+
+		restoreJobOptions(d_jobDefaults);
+		// A job's own events and securities replace the command line's
+		if (events) {
+			d_events.clear();
+		}
+		if (securities) {
+			d_security.clear();
+			d_securitiesFile.clear();
+		}
+		std::vector<char *> argv(1, (char *)"job");
+		for (size_t i = 0; i < words.size(); ++i) {
+			argv.push_back(&words[i][0]);
+		}
+		if (!parseCommandLine((int)argv.size(), &argv[0]) || !setConfig()) return false;
+		// Decoding may start as soon as the first request is queued
+		if (!openDictionaries() || !openPublisher()) return false;
+
+		++d_jobNumber;
+		d_jobStart = nowMicros();
+		{
+			// The sessions' threads send each chunk as it is queued
+			std::lock_guard<std::mutex> lock(d_scheduleMutex);
+			d_requests.clear();
+			d_chunks.clear();
+			d_retries.clear();
+			d_queued = WorkQueues(d_endpoints.size());
+			d_pendingRetries = 0;
+			if (!loadSecurities()) {
+				d_log.error() << "No securities to request in job " << d_jobNumber;
+				return false;
+			}
+			if (!planRequests()) return false;
+			d_backfillDone = backfillDone();
+		}
+		d_jobRunning = true;
+		d_log.info() << "Job " << d_jobNumber << ": " << d_requests.size() << " securities, "
+			<< d_chunks.size() << " requests: " << line;
+		return true;
+	}
+
+	// Writer side, with nothing of the job left to receive
+	void finishJob()
+	{
+		finishOutput();
+		d_jobRunning = false;
+		d_log.info() << "Job " << d_jobNumber << " done in "
+			<< (nowMicros() - d_jobStart) / 1000 << "ms";
+	}
+
+	// @TODO @BADCODE @CLEANUP
+	// Really bad pattern of littering file management all over the place
+	// Make new class or data structure for this
+	std::string makeFileName(const std::string &security, std::string datetime) {
+		std::string file_name = security;
+		std::replace(file_name.begin(), file_name.end(), ' ', '-');
+		file_name += "_";
+		file_name += datetime.substr(0, 10);
+		file_name += d_binary ? ".bin" : ".csv";
+		return file_name;
+	}
+
+	std::string makeBarFileName(const std::string &security, long long day) {
+		std::string file_name = security;
+		std::replace(file_name.begin(), file_name.end(), ' ', '-');
+		file_name += "_";
+		file_name += timeutil::formatDateTime(day * timeutil::SECONDS_PER_DAY).substr(0, 10);
+		file_name += ".bars" + std::to_string(d_barSeconds) + ".csv";
+		return file_name;
+	}
+
+	std::string makeManifestName(const std::string &security) {
+		std::string file_name = security;
+		std::replace(file_name.begin(), file_name.end(), ' ', '-');
+		file_name += d_binary ? ".bin.manifest" : ".csv.manifest";
+		return file_name;
+	}
+
+	void reloadFile(SecurityRequest &req, long long day) {
+		req.current_day = day;
+		std::string file_name = makeFileName(req.security,
+			timeutil::formatDateTime(day * timeutil::SECONDS_PER_DAY));
+
+		// The first time this run opens a day, drop anything past its last
+		// checkpoint, left by a run that died partway through
+		if (req.manifest.isOpen() && day > req.truncated_day) {
+			if (!truncateFile(file_name, req.manifest.entry(day).bytes)) {
+				d_log.error() << "Failed to truncate " << file_name;
+			}
+			req.truncated_day = day;
+		}
+
+		// Kept open until the registry needs the handle for another file
+		size_t index = securityIndex(req);
+		bool opened;
+		if (d_binary) {
+			req.bin_file = d_binFiles.acquire(index, day, file_name);
+			req.file_evictions = d_binFiles.evictions();
+			opened = req.bin_file != NULL;
+			if (opened && (d_conditionCodes || d_exchangeCodes)) {
+				req.bin_file->enableCodes();
+			}
+			if (opened && d_packBlocks) {
+				req.bin_file->enablePacking();
+			}
+		}
+		else {
+			req.csv_file = d_csvFiles.acquire(index, day, file_name);
+			req.file_evictions = d_csvFiles.evictions();
+			opened = req.csv_file != NULL;
+		}
+		if (!opened) {
+			d_log.error() << "Failed to open " << file_name;
+		}
+	}
+
+	// If the date has changed, return true
+	bool dateChanged(const SecurityRequest &req, long long day) {
+		return day != req.current_day;
+	}
+
+	// Any eviction may have closed the file req points at
+	bool fileEvicted(const SecurityRequest &req) {
+		return req.file_evictions != (d_binary ? d_binFiles.evictions() : d_csvFiles.evictions());
+	}
+
+	size_t securityIndex(const SecurityRequest &req) {
+		return (size_t)(&req - &d_requests[0]);
+	}
+
+	// Size of the security's file for day with everything written so far
+	long long writtenBarBytes(SecurityRequest &req, long long day) {
+		CsvSink *sink = d_barFiles.find(securityIndex(req), day);
+		if (sink) {
+			return sink->tell();
+		}
+		return fileSize(makeBarFileName(req.security, day));
+	}
+
+	long long writtenBytes(SecurityRequest &req, long long day) {
+		size_t index = securityIndex(req);
+		if (d_binary) {
+			BinSink *sink = d_binFiles.find(index, day);
+			if (sink) {
+				return sink->tell();
+			}
+		}
+		else {
+			CsvSink *sink = d_csvFiles.find(index, day);
+			if (sink) {
+				return sink->tell();
+			}
+		}
+		return fileSize(makeFileName(req.security,
+			timeutil::formatDateTime(day * timeutil::SECONDS_PER_DAY)));
+	}
+
+	void unloadFile(SecurityRequest &req) {
+		if (d_barSeconds) {
+			flushBars(req);
+			d_barFiles.closeSecurity(securityIndex(req));
+		}
+		d_csvFiles.closeSecurity(securityIndex(req));
+		d_binFiles.closeSecurity(securityIndex(req));
+		req.csv_file = NULL;
+		req.bin_file = NULL;
+		req.current_day = -1;
+	}
+
+	// The built-in markets, then -tc's
+	bool loadCalendar()
+	{
+		d_calendar = TradingCalendar();
+		int badLine;
+		if (!d_calendarFile.empty() && !d_calendar.load(d_calendarFile, &badLine)) {
+			if (badLine) {
+				d_log.error() << "Bad line " << badLine << " in " << d_calendarFile;
+			}
+			else {
+				d_log.error() << "Failed to read " << d_calendarFile;
+			}
+			return false;
+		}
+		return true;
+	}
+
+	// For interactive; with -n, whatever is missing is an error
+	bool setConfig()
+	{
+		if (!loadCalendar()) return false;
+		// Live runs default to backfilling today
+		if (d_live) {
+			d_startDateTime_assigned = true;
+			d_endDateTime_assigned = true;
+		}
+		if (d_non_interactive) {
+			if (!d_security_assigned || !d_startDateTime_assigned || !d_endDateTime_assigned) {
+				d_log.error() << "-n needs -s or -f, -sd and -ed";
+				return false;
+			}
+			return true;
+		}
+		// Prompts go straight to the console, after anything queued
+		d_log.flush();
+		if (!d_security_assigned) {
+			setSecurity();
+		}
+		if (!d_startDateTime_assigned) {
+			setStartDateTime();
+		}
+		if (!d_endDateTime_assigned) {
+			setEndDateTime();
+		}
+		return true;
+	}
+
+	void setSecurity()
+	{
+		std::string x;
+		std::cout << "Provide ticker: ";
+		std::getline(std::cin, x);
+		d_security = x;
+	}
+
+	void setStartDateTime()
+	{
+		std::string x;
+		std::cout << "Provide start date: ";
+		std::getline(std::cin, x);
+		d_startDateTime = x;
+	}
+
+	void setEndDateTime()
+	{
+		std::string x;
+		std::cout << "Provide end date: ";
+		std::getline(std::cin, x);
+		d_endDateTime = x;
+	}
+
+public:
+
+	IntradayTick()
+	{
+		d_port = 8194;
+		d_security_assigned = false;
+		d_startDateTime_assigned = false;
+		d_endDateTime_assigned = false;
 		d_non_interactive = false;
+		d_logLevel_assigned = false;
+		d_maxInFlight = 50;
+		d_requestsPerSecond = 0;
+		d_maxRetries = 5;
+		d_metricsInterval = 10;
+		d_startMicros = nowMicros();
+		d_lastReport = d_startMicros;
+		d_lastTicks = 0;
+		d_lastBytes = 0;
+		d_pendingRetries = 0;
+		d_holding = false;
+		d_holdStart = 0;
+		d_chunkHours = 0;
+		d_sessionsOnly = false;
+		d_async = false;
+		d_dispatcherThreads = 1;
+		d_ringCapacity = 65536;
+		d_maxOpenFiles = 64;
+		d_maxBufferMB = 256;
+		d_binary = false;
+		d_nullOutput = false;
+		d_live = false;
+		d_liveFrom = 0;
+		d_liveEnd = 0;
+		d_liveTypes = 0;
+		d_lastLiveFlush = 0;
+		d_liveSubscribed = false;
+		d_barSeconds = 0;
+		d_conditionCodes = false;
+		d_exchangeCodes = false;
+		d_packBlocks = false;
+		d_validate = false;
+		d_nextRing = 0;
+		d_dispatchers = 0;
+		d_backfillDone = false;
+		d_producersDone = false;
+		d_writerPasses = 0;
+		d_heldTicks = 0;
+		d_jobRunning = false;
+		d_jobNumber = 0;
+		d_jobStart = 0;
+		d_stopping = false;
+		d_endpointsUp = 0;
+		selectOutput();
 	}
 
 	~IntradayTick() {
+		for (size_t i = 0; i < d_rings.size(); ++i) {
+			delete d_rings[i];
+			delete d_arenas[i];
+		}
+		for (size_t i = 0; i < d_endpoints.size(); ++i) {
+			delete d_endpoints[i];
+		}
+	}
+
+	// Passes an endpoint's events on with the endpoint, so its dispatcher
+	// threads know whose rings are theirs
+	class EndpointHandler : public EventHandler {
+
+		IntradayTick				*d_scraper;
+		Endpoint					*d_endpoint;
+
+	public:
+
+		EndpointHandler(IntradayTick *scraper, Endpoint *endpoint)
+			: d_scraper(scraper)
+			, d_endpoint(endpoint)
+		{
+		}
+
+		bool processEvent(const Event &event, Session *session)
+		{
+			return d_scraper->processEvent(event, session, *d_endpoint);
+		}
+	};
+
+	// Async mode: runs on the endpoint's EventDispatcher threads
+	bool processEvent(const Event &event, Session *session, Endpoint &e)
+	{
+		if (event.eventType() == Event::PARTIAL_RESPONSE
+			|| event.eventType() == Event::RESPONSE
+			|| event.eventType() == Event::REQUEST_STATUS) {
+			if (processResponseEvent(event, producerSlot(e))) {
+				d_backfillDone.store(true, std::memory_order_release);
+			}
+		}
+		else if (event.eventType() == Event::SUBSCRIPTION_DATA) {
+			processSubscriptionEvent(event, producerSlot(e));
+		}
+		else if (event.eventType() == Event::SUBSCRIPTION_STATUS) {
+			processSubscriptionStatus(event);
+		}
+		else if (event.eventType() == Event::SESSION_STATUS) {
+			MessageIterator msgIter(event);
+			while (msgIter.next()) {
+				if (msgIter.message().messageType() == SESSION_TERMINATED) {
+					// Not once the session is being stopped
+					std::lock_guard<std::mutex> lock(d_scheduleMutex);
+					if (e.session == session) {
+						e.sessionEnded.store(true, std::memory_order_release);
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	// Ids only need a dictionary once they are stored; CSV rows carry names
+	bool openDictionaries()
+	{
+		if ((d_conditionCodes || d_exchangeCodes) && !d_codes.open(CODES_FILE)) {
+			d_log.error() << "Failed to open " << CODES_FILE;
+			return false;
+		}
+		if ((d_binary || !d_captureFile.empty() || !d_publishName.empty())
+			&& !d_types.open(TYPES_FILE)) {
+			d_log.error() << "Failed to open " << TYPES_FILE;
+			return false;
+		}
+		return true;
+	}
+
+	bool openPublisher()
+	{
+		if (d_publishName.empty()) {
+			return true;
+		}
+		long long runId = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		if (!d_publisher.open(d_publishName, SHARED_TICK_CAPACITY, (uint64_t)runId)) {
+			d_log.error() << "Failed to create shared memory " << d_publishName;
+			return false;
+		}
+		return true;
+	}
+
+	// Every day file of the range is mapped and searched by its blocks'
+	// time index, so only the ticks asked for are read
+	void runQuery()
+	{
+		long long start, end;
+		if (!requestRange(&start, &end)) return;
+		// Types past the TickType names are only known from the dictionary
+		if (fileSize(TYPES_FILE) > 0 && !d_types.open(TYPES_FILE)) {
+			d_log.error() << "Failed to open " << TYPES_FILE;
+			return;
+		}
+		CsvSink out;
+		if (!out.open(d_queryFile)) {
+			d_log.error() << "Failed to open " << d_queryFile;
+			return;
+		}
+
+		const bool codes = d_conditionCodes || d_exchangeCodes;
+		const long long from = start * timeutil::NANOS_PER_SECOND;
+		const long long to = (end + 1) * timeutil::NANOS_PER_SECOND;
+		size_t files = 0, scanned = 0, ticks = 0;
+		for (size_t s = 0; s < d_requests.size(); ++s) {
+			const std::string prefix = d_requests[s].security + ",";
+			auto row = [&](const TickBlockView &block, uint32_t i) {
+				char buf[csv::MAX_ROW];
+				std::string interned;
+				const char *type = tickTypeName(block.types[i], d_types, interned);
+				size_t len = codes
+					? csv::formatRowWithCodes(buf, block.times[i], type, block.values[i],
+						block.sizes[i], block.conditions ? block.conditions[i] : 0,
+						block.exchanges ? block.exchanges[i] : 0)
+					: csv::formatRow(buf, block.times[i], type, block.values[i], block.sizes[i]);
+				out.write(prefix.data(), prefix.size());
+				out.write(buf, len);
+			};
+
+			long long last = timeutil::dayNumber(to - 1);
+			for (long long day = timeutil::dayNumber(from); day <= last; ++day) {
+				std::string file_name = makeFileName(d_requests[s].security,
+					timeutil::formatDateTime(day * timeutil::SECONDS_PER_DAY));
+				TickFileReader reader;
+				if (!reader.open(file_name)) {
+					continue;
+				}
+				if (!reader.ordered()) {
+					d_log.debug() << file_name << ": blocks overlap, scanning each";
+				}
+				++files;
+				scanned += reader.ticks();
+				ticks += reader.query(from, to, row);
+			}
+		}
+		out.close();
+		d_log.info() << "Wrote " << ticks << " of " << scanned << " ticks in " << files
+			<< " files to " << d_queryFile;
 	}
 
 	void run(int argc, char **argv)
 	{
 		if (!parseCommandLine(argc, argv)) return;
-		setConfig();
+		if (!d_replayFile.empty()) {
+			runReplay();
+			return;
+		}
+		const bool daemon = d_jobs.isOpen();
+		if (!daemon) {
+			if (!setConfig()) return;
+			if (!loadSecurities()) {
+				d_log.error() << "No securities to request.";
+				return;
+			}
+			if (!d_queryFile.empty()) {
+				runQuery();
+				return;
+			}
+		}
+		if (!createEndpoints()) return;
+		if (daemon) {
+			// Jobs are planned as they come, on the sessions started below
+			saveJobOptions(&d_jobDefaults);
+			d_log.info() << "Taking jobs from " << d_jobs.path();
+		}
+		else {
+			if (!planRequests()) return;
+			if (!openDictionaries()) return;
+			if (!openPublisher()) return;
+			if (!d_captureFile.empty() && !openCapture()) return;
+		}
+
+		// Each endpoint's dispatcher threads get rings of their own
+		createRings(d_async ? d_dispatcherThreads * d_endpoints.size() + 1 : 1);
+
+		if (d_async) {
+			runSessions();
+		}
+		else {
+			Endpoint &e = *d_endpoints[0];
+			for (int restarts = 0; ; ++restarts) {
+				if (runSync(e)) {
+					break;
+				}
+				// A daemon gives up only on a host that stays down
+				if (daemonRunning() && e.connected) {
+					restarts = 0;
+				}
+				if (!restartSession(e, restarts)) {
+					break;
+				}
+			}
+		}
+		if (!daemon) {
+			finishOutput();
+		}
+		else if (d_jobRunning) {
+			finishJob();
+		}
+		printRingUsage();
+	}
+
+	// One per -ip, each with a queue of its own to be dealt work into
+	bool createEndpoints()
+	{
+		long long now = nowMicros();
+		for (size_t i = 0; i < d_hosts.size(); ++i) {
+			Endpoint *e = new Endpoint;
+			d_endpoints.push_back(e);
+			e->index = i;
+			e->host = d_hosts[i];
+			e->port = d_port;
+			size_t colon = d_hosts[i].rfind(':');
+			if (colon != std::string::npos) {
+				e->host = d_hosts[i].substr(0, colon);
+				e->port = std::atoi(d_hosts[i].c_str() + colon + 1);
+			}
+			if (e->host.empty() || e->port <= 0) {
+				d_log.error() << "Bad -ip " << d_hosts[i];
+				return false;
+			}
+			e->scheduler.configure(d_maxInFlight, d_requestsPerSecond, now);
+			e->session = NULL;
+			e->sessionEnded = false;
+			e->connected = false;
+			e->dispatcher = 0;
+			e->nextSlot = 0;
+		}
+		d_queued.resize(d_endpoints.size());
+		return true;
+	}
+
+	// Under the lock requestDone takes before sending on it
+	void setSession(Endpoint &e, Session *session)
+	{
+		std::lock_guard<std::mutex> lock(d_scheduleMutex);
+		e.session = session;
+	}
 
+	// Returns false if the session could not start or ended early
+	bool runSync(Endpoint &e)
+	{
+		e.connected = false;
 		SessionOptions sessionOptions;
-		sessionOptions.setServerHost(d_host.c_str());
-		sessionOptions.setServerPort(d_port);
+		sessionOptions.setServerHost(e.host.c_str());
+		sessionOptions.setServerPort(e.port);
 
-		std::cout << "Connecting to " << d_host << ":" << d_port << std::endl;
+		d_log.info() << "Connecting to " << e.host << ":" << e.port;
 		Session session(sessionOptions);
 		if (!session.start()) {
-			std::cerr << "Failed to start session." << std::endl << std::endl;
-			return;
+			d_log.error() << "Failed to start session.";
+			return false;
 		}
 		if (!session.openService("//blp/refdata")) {
-			std::cerr << "Failed to open //blp/refdata" << std::endl;
-			return;
+			d_log.error() << "Failed to open //blp/refdata";
+			session.stop();
+			return false;
+		}
+		e.connected = true;
+
+		if (d_live) {
+			if (!session.openService("//blp/mktdata")) {
+				d_log.error() << "Failed to open //blp/mktdata";
+				session.stop();
+				return false;
+			}
+			subscribeLive(session);
+		}
+
+		// wait for events from session, sending queued requests as slots free up
+		setSession(e, &session);
+		bool finished = eventLoop(e);
+		setSession(e, NULL);
+
+		session.stop();
+		return finished;
+	}
+
+	// Receive and decode on each endpoint's dispatcher threads, write on a
+	// thread of its own, joined through d_rings
+	void runSessions()
+	{
+		{
+			std::lock_guard<std::mutex> lock(d_scheduleMutex);
+			d_backfillDone = backfillDone();
+		}
+		// A daemon's writer runs only while it has a job
+		std::thread writer;
+		d_producersDone = d_jobs.isOpen();
+		if (!d_producersDone) {
+			writer = std::thread(&IntradayTick::writerLoop, this);
+		}
+
+		d_endpointsUp = (int)d_endpoints.size();
+		std::vector<std::thread> sessions;
+		for (size_t i = 0; i < d_endpoints.size(); ++i) {
+			sessions.push_back(std::thread(&IntradayTick::runEndpoint, this, d_endpoints[i]));
+		}
+		if (d_jobs.isOpen()) {
+			runJobs(writer);
+		}
+		for (size_t i = 0; i < sessions.size(); ++i) {
+			sessions[i].join();
+		}
+
+		// No more events once every session is stopped; the writer drains
+		// the rings and exits
+		d_producersDone.store(true, std::memory_order_release);
+		if (writer.joinable()) {
+			writer.join();
+		}
+	}
+
+	// Async daemon: each job is finished, and the next one's output chosen,
+	// here while the writer is stopped. This thread also reports.
+	void runJobs(std::thread &writer)
+	{
+		while (daemonRunning() && d_endpointsUp.load() > 0) {
+			maybePrintMetrics();
+			if (d_jobRunning) {
+				if (!d_backfillDone.load(std::memory_order_acquire)) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+					continue;
+				}
+				d_producersDone.store(true, std::memory_order_release);
+				writer.join();
+				finishJob();
+			}
+			if (startNextJob()) {
+				d_producersDone = false;
+				writer = std::thread(&IntradayTick::writerLoop, this);
+			}
+			else {
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+			}
+		}
+		if (d_endpointsUp.load() == 0) {
+			d_log.error() << "Every session is down; stopping";
+		}
+		// Lets the sessions stop
+		d_stopping = true;
+	}
+
+	// A session that ends early is started again for what it still owed
+	void runEndpoint(Endpoint *e)
+	{
+		for (int restarts = 0; ; ++restarts) {
+			if (runAsync(*e)) {
+				break;
+			}
+			// A daemon gives up only on a host that stays down
+			if (daemonRunning() && e->connected) {
+				restarts = 0;
+			}
+			if (!restartSession(*e, restarts)) {
+				break;
+			}
 		}
+		--d_endpointsUp;
+	}
+
+	// Returns false if the session could not start or ended early
+	bool runAsync(Endpoint &e)
+	{
+		e.sessionEnded = false;
+		e.connected = false;
+		SessionOptions sessionOptions;
+		sessionOptions.setServerHost(e.host.c_str());
+		sessionOptions.setServerPort(e.port);
 
-		sendIntradayTickRequest(session);
+		e.dispatcher = ++d_dispatchers;
+		e.nextSlot = 0;
+		EventDispatcher dispatcher(d_dispatcherThreads);
+		EndpointHandler handler(this, &e);
+		dispatcher.start();
+
+		d_log.info() << "Connecting to " << e.host << ":" << e.port
+			<< " with " << d_dispatcherThreads << " dispatcher thread(s)";
+		Session session(sessionOptions, &handler, &dispatcher);
+		setSession(e, &session);
+		if (!session.start()) {
+			d_log.error() << "Failed to start session to " << e.host << ":" << e.port;
+			setSession(e, NULL);
+			dispatcher.stop();
+			return false;
+		}
+		if (!session.openService("//blp/refdata")) {
+			d_log.error() << "Failed to open //blp/refdata";
+			setSession(e, NULL);
+			session.stop();
+			dispatcher.stop();
+			return false;
+		}
+		e.connected = true;
+		bool live = d_live && e.index == 0;
+		if (live && !session.openService("//blp/mktdata")) {
+			d_log.error() << "Failed to open //blp/mktdata";
+			setSession(e, NULL);
+			session.stop();
+			dispatcher.stop();
+			return false;
+		}
+		if (live) {
+			subscribeLive(session);
+		}
 
-		// wait for events from session.
-		eventLoop(session);
+		// Responses send what they can as they free slots; this thread
+		// covers requests held back by the rate limit or a retry backoff
+		while ((!d_backfillDone.load(std::memory_order_acquire) || (live && liveRunning())
+			|| daemonRunning()) && !e.sessionEnded.load(std::memory_order_acquire)) {
+			{
+				std::lock_guard<std::mutex> lock(d_scheduleMutex);
+				sendQueuedRequests(e);
+			}
+			if (e.index == 0 && !d_jobs.isOpen()) {
+				maybePrintMetrics();
+			}
+			long long wait = pacingWait(e);
+			std::this_thread::sleep_for(std::chrono::microseconds(
+				wait > 0 && wait < 10000 ? wait : 10000));
+		}
+		bool finished = d_backfillDone.load(std::memory_order_acquire)
+			&& !(live && liveRunning()) && !daemonRunning();
 
+		// No more events from this session once both are stopped
+		setSession(e, NULL);
 		session.stop();
+		dispatcher.stop();
+		return finished;
 	}
 
 	bool isInteractive() {
-		return d_non_interactive;
+		return !d_non_interactive;
+	}
+
+	// Everything logged so far is on the console
+	void flushLog() {
+		d_log.flush();
 	}
 };
 
@@ -418,11 +3127,13 @@ int main(int argc, char **argv)
 		scraper.run(argc, argv);
 	}
 	catch (Exception &e) {
+		scraper.flushLog();
 		std::cerr << "Library Exception!!! " << e.description() << std::endl << std::endl;
 	}
+	scraper.flushLog();
 
 	// Directly exit if flag is set
-	if (scraper.isInteractive()) {
+	if (!scraper.isInteractive()) {
 		std::cout << "Directly exiting..." << std::endl;
 		return 0;
 	}
@@ -0,0 +1,104 @@
+// jobfile.h : jobs for daemon mode, one per line of a file that is added
+// to while the scraper runs
+//
+// A line holds a job's options as they would be given on the command line,
+// with double quotes around words that contain spaces, e.g.
+//
+//   -s "IBM US Equity" -sd 2017-04-24T00:00:00 -ed 2017-04-24T23:59:59 -o bin
+//
+// Blank lines and lines starting with # are skipped. A line is taken only
+// once its newline is there, so a job still being written is never read
+// half done. The file is read from its start, then followed for new lines;
+// a file cut shorter than what was read is read again from its start.
+//
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+class JobFile {
+
+	std::string					d_path;
+	long long					d_offset;		// bytes of whole lines taken
+
+public:
+
+	JobFile()
+		: d_offset(0)
+	{
+	}
+
+	void open(const std::string &path)
+	{
+		d_path = path;
+		d_offset = 0;
+	}
+
+	bool isOpen() const
+	{
+		return !d_path.empty();
+	}
+
+	const std::string &path() const
+	{
+		return d_path;
+	}
+
+	// The next job's line, false if none has been added yet
+	bool next(std::string *line)
+	{
+		std::ifstream file(d_path.c_str(), std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		file.seekg(0, std::ios::end);
+		if ((long long)file.tellg() < d_offset) {
+			d_offset = 0;
+		}
+		file.seekg(d_offset);
+
+		std::string text;
+		while (std::getline(file, text) && !file.eof()) {
+			d_offset += text.size() + 1;
+			text.erase(text.find_last_not_of(" \t\r") + 1);
+			text.erase(0, text.find_first_not_of(" \t"));
+			if (!text.empty() && text[0] != '#') {
+				line->swap(text);
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+// The words of a job line; false if a quote is left open
+inline bool splitJobLine(const std::string &line, std::vector<std::string> *words)
+{
+	words->clear();
+	size_t i = 0;
+	for (;;) {
+		while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) {
+			++i;
+		}
+		if (i == line.size()) {
+			return true;
+		}
+		std::string word;
+		while (i < line.size() && line[i] != ' ' && line[i] != '\t') {
+			if (line[i] == '"') {
+				size_t close = line.find('"', i + 1);
+				if (close == std::string::npos) {
+					return false;
+				}
+				word.append(line, i + 1, close - i - 1);
+				i = close + 1;
+			}
+			else {
+				word += line[i++];
+			}
+		}
+		words->push_back(word);
+	}
+}
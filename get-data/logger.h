@@ -0,0 +1,228 @@
+// logger.h : leveled console output written from a thread of its own
+//
+// Callers format a line and queue it; a background thread writes queued
+// lines in batches, so a slow console never holds up the thread that
+// logged. Lines below the level are dropped before they are formatted:
+//
+//   d_log.info() << security << ": resuming from " << time;
+//
+// Errors and warnings go to stderr, the rest to stdout. Once the queue
+// holds MAX_QUEUED lines, further lines are counted and dropped rather
+// than waited for.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+enum LogLevel {
+	LOG_ERROR,
+	LOG_WARN,
+	LOG_INFO,
+	LOG_DEBUG
+};
+
+// "error", "warn", "info" or "debug"
+inline bool parseLogLevel(const char *name, LogLevel *level)
+{
+	static const char *const names[] = { "error", "warn", "info", "debug" };
+	for (int i = 0; i <= LOG_DEBUG; ++i) {
+		if (!strcmp(name, names[i])) {
+			*level = (LogLevel)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+class Logger;
+
+// One line, queued when the statement that built it ends
+class LogLine {
+
+	Logger					*d_logger;		// NULL if the level is off
+	LogLevel				d_level;
+	std::ostringstream		d_text;
+
+	LogLine &operator=(const LogLine &);
+
+public:
+
+	LogLine(Logger *logger, LogLevel level)
+		: d_logger(logger)
+		, d_level(level)
+	{
+	}
+
+	LogLine(LogLine &&other)
+		: d_logger(other.d_logger)
+		, d_level(other.d_level)
+		, d_text(std::move(other.d_text))
+	{
+		other.d_logger = NULL;
+	}
+
+	inline ~LogLine();
+
+	template <typename T>
+	LogLine &operator<<(const T &value)
+	{
+		if (d_logger) {
+			d_text << value;
+		}
+		return *this;
+	}
+};
+
+class Logger {
+
+	struct Entry {
+		LogLevel				level;
+		std::string				text;
+	};
+
+	std::atomic<int>			d_level;		// a LogLevel; -d jobs set it while others log
+	std::deque<Entry>			d_queue;
+	std::mutex					d_mutex;
+	std::condition_variable		d_wake;			// lines queued, or stopping
+	std::condition_variable		d_drained;		// queue emptied
+	bool						d_writing;		// a batch is off the queue but not written
+	bool						d_stop;
+	size_t						d_dropped;
+	std::thread					d_thread;
+
+	static const size_t			MAX_QUEUED = 100000;
+
+	Logger(const Logger &);
+	Logger &operator=(const Logger &);
+
+	void writerLoop()
+	{
+		std::deque<Entry> batch;
+		std::unique_lock<std::mutex> lock(d_mutex);
+		for (;;) {
+			d_wake.wait(lock, [this] { return d_stop || !d_queue.empty(); });
+			if (d_queue.empty()) {
+				return;
+			}
+			batch.swap(d_queue);
+			size_t dropped = d_dropped;
+			d_dropped = 0;
+			d_writing = true;
+			lock.unlock();
+
+			bool err = false, out = false;
+			for (size_t i = 0; i < batch.size(); ++i) {
+				FILE *stream = batch[i].level <= LOG_WARN ? stderr : stdout;
+				fwrite(batch[i].text.data(), 1, batch[i].text.size(), stream);
+				fputc('\n', stream);
+				(stream == stderr ? err : out) = true;
+			}
+			if (dropped) {
+				fprintf(stderr, "(%u log lines dropped)\n", (unsigned)dropped);
+				err = true;
+			}
+			if (out) {
+				fflush(stdout);
+			}
+			if (err) {
+				fflush(stderr);
+			}
+			batch.clear();
+
+			lock.lock();
+			d_writing = false;
+			if (d_queue.empty()) {
+				d_drained.notify_all();
+			}
+		}
+	}
+
+public:
+
+	explicit Logger(LogLevel level = LOG_INFO)
+		: d_level(level)
+		, d_writing(false)
+		, d_stop(false)
+		, d_dropped(0)
+	{
+		d_thread = std::thread(&Logger::writerLoop, this);
+	}
+
+	// Writes whatever is still queued
+	~Logger()
+	{
+		{
+			std::lock_guard<std::mutex> lock(d_mutex);
+			d_stop = true;
+		}
+		d_wake.notify_one();
+		d_thread.join();
+	}
+
+	// Lines already being formatted keep the level they were started under
+	void setLevel(LogLevel level)
+	{
+		d_level.store(level, std::memory_order_relaxed);
+	}
+
+	bool enabled(LogLevel level) const
+	{
+		return level <= d_level.load(std::memory_order_relaxed);
+	}
+
+	LogLine line(LogLevel level)
+	{
+		return LogLine(enabled(level) ? this : NULL, level);
+	}
+
+	LogLine error() { return line(LOG_ERROR); }
+	LogLine warn() { return line(LOG_WARN); }
+	LogLine info() { return line(LOG_INFO); }
+	LogLine debug() { return line(LOG_DEBUG); }
+
+	void write(LogLevel level, std::string &&text)
+	{
+		bool wake;
+		{
+			std::lock_guard<std::mutex> lock(d_mutex);
+			if (d_queue.size() >= MAX_QUEUED) {
+				++d_dropped;
+				return;
+			}
+			wake = d_queue.empty();
+			d_queue.emplace_back();
+			d_queue.back().level = level;
+			d_queue.back().text.swap(text);
+		}
+		if (wake) {
+			d_wake.notify_one();
+		}
+	}
+
+	// Waits until everything queued so far is on the console, e.g. before
+	// prompting
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock(d_mutex);
+		d_drained.wait(lock, [this] { return d_queue.empty() && !d_writing; });
+	}
+};
+
+inline LogLine::~LogLine()
+{
+	if (d_logger) {
+		d_logger->write(d_level, d_text.str());
+	}
+}
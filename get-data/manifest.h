@@ -0,0 +1,219 @@
+// manifest.h : per-security record of how far a backfill got
+//
+// One line is appended each time a chunk of the security is completely
+// written:
+//
+//   day,lastTick,resumeFrom,bytes[,barBytes]
+//   2016-05-30,2016-05-30T20:59:59.998,2016-05-31T00:00:00,183321
+//
+// lastTick is the newest tick written to that day's file, resumeFrom the
+// GMT second the next run starts requesting from, and bytes the size of the
+// day's file at that point. barBytes, there when bars are written, is the
+// size of the day's bar file. A later line for the same day replaces an
+// earlier one, so a torn last line from a crash only loses that checkpoint.
+//
+
+#pragma once
+
+#include <io.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+#include "timeutil.h"
+
+struct ManifestEntry {
+	long long					day;			// day number
+	long long					lastTick;		// epoch nanos, -1 if no ticks that day
+	long long					resumeFrom;		// epoch seconds
+	long long					bytes;
+	long long					barBytes;		// -1 if bars are not written
+};
+
+class Manifest {
+
+	FILE								*d_file;
+	std::map<long long, ManifestEntry>	d_days;
+	long long							d_resumeFrom;
+
+	Manifest(const Manifest &);
+	Manifest &operator=(const Manifest &);
+
+	static bool parseLine(const char *line, ManifestEntry *entry)
+	{
+		long long day, resumeFrom;
+		const char *lastTick = strchr(line, ',');
+		const char *resume = lastTick ? strchr(lastTick + 1, ',') : NULL;
+		const char *bytes = resume ? strchr(resume + 1, ',') : NULL;
+		if (!bytes || !timeutil::parseDateTime(line, &day)
+			|| !timeutil::parseDateTime(resume + 1, &resumeFrom)) {
+			return false;
+		}
+		char *end;
+		long long size = strtoll(bytes + 1, &end, 10);
+		long long barSize = -1;
+		if (end != bytes + 1 && *end == ',') {
+			const char *bars = end + 1;
+			barSize = strtoll(bars, &end, 10);
+			if (end == bars) {
+				return false;
+			}
+		}
+		else if (end == bytes + 1) {
+			return false;
+		}
+		if (*end != '\n' && *end != '\r' && *end != '\0') {
+			return false;
+		}
+
+		entry->day = day / timeutil::SECONDS_PER_DAY;
+		if (lastTick[1] == ',' || !timeutil::parseTickTime(lastTick + 1, &entry->lastTick)) {
+			entry->lastTick = -1;
+		}
+		entry->resumeFrom = resumeFrom;
+		entry->bytes = size;
+		entry->barBytes = barSize;
+		return true;
+	}
+
+public:
+
+	Manifest()
+		: d_file(NULL)
+		, d_resumeFrom(-1)
+	{
+	}
+
+	Manifest(Manifest &&other)
+		: d_file(other.d_file)
+		, d_days(std::move(other.d_days))
+		, d_resumeFrom(other.d_resumeFrom)
+	{
+		other.d_file = NULL;
+	}
+
+	~Manifest()
+	{
+		close();
+	}
+
+	// Reads whatever checkpoints are already there and keeps the file open
+	// for appending more
+	bool open(const std::string &path)
+	{
+		close();
+		bool torn = false;
+		FILE *in;
+		if (fopen_s(&in, path.c_str(), "rb") == 0) {
+			char line[256];
+			ManifestEntry entry;
+			while (fgets(line, sizeof(line), in)) {
+				torn = line[strlen(line) - 1] != '\n';
+				if (parseLine(line, &entry)) {
+					d_days[entry.day] = entry;
+					if (entry.resumeFrom > d_resumeFrom) {
+						d_resumeFrom = entry.resumeFrom;
+					}
+				}
+			}
+			fclose(in);
+		}
+		if (fopen_s(&d_file, path.c_str(), "ab") != 0) {
+			d_file = NULL;
+			return false;
+		}
+		// Keep the next checkpoint off a line torn by a crash
+		if (torn) {
+			fputc('\n', d_file);
+		}
+		return true;
+	}
+
+	bool isOpen() const
+	{
+		return d_file != NULL;
+	}
+
+	void close()
+	{
+		if (d_file) {
+			fclose(d_file);
+			d_file = NULL;
+		}
+	}
+
+	// Epoch seconds to restart from, -1 if nothing has been checkpointed
+	long long resumeFrom() const
+	{
+		return d_resumeFrom;
+	}
+
+	// Last checkpoint of a day; lastTick -1 and both sizes 0 if there is
+	// none
+	ManifestEntry entry(long long day) const
+	{
+		std::map<long long, ManifestEntry>::const_iterator it = d_days.find(day);
+		if (it != d_days.end()) {
+			return it->second;
+		}
+		ManifestEntry none = { day, -1, -1, 0, 0 };
+		return none;
+	}
+
+	void record(const ManifestEntry &entry)
+	{
+		d_days[entry.day] = entry;
+		if (entry.resumeFrom > d_resumeFrom) {
+			d_resumeFrom = entry.resumeFrom;
+		}
+		if (!d_file) {
+			return;
+		}
+
+		char lastTick[24] = "";
+		if (entry.lastTick >= 0) {
+			timeutil::formatTickTime(entry.lastTick, lastTick);
+			lastTick[23] = '\0';
+		}
+		std::string day = timeutil::formatDateTime(entry.day * timeutil::SECONDS_PER_DAY);
+		fprintf(d_file, "%s,%s,%s,%lld", day.substr(0, 10).c_str(), lastTick,
+			timeutil::formatDateTime(entry.resumeFrom).c_str(), entry.bytes);
+		if (entry.barBytes >= 0) {
+			fprintf(d_file, ",%lld", entry.barBytes);
+		}
+		fputc('\n', d_file);
+		fflush(d_file);
+	}
+};
+
+// Bytes in a file, 0 if it does not exist
+inline long long fileSize(const std::string &path)
+{
+	FILE *file;
+	if (fopen_s(&file, path.c_str(), "rb") != 0) {
+		return 0;
+	}
+	fseek(file, 0, SEEK_END);
+	long long size = _ftelli64(file);
+	fclose(file);
+	return size;
+}
+
+// Cuts a file back to bytes if it has grown past that; a missing file is
+// left alone
+inline bool truncateFile(const std::string &path, long long bytes)
+{
+	FILE *file;
+	if (fopen_s(&file, path.c_str(), "r+b") != 0) {
+		return true;
+	}
+	fseek(file, 0, SEEK_END);
+	bool ok = true;
+	if (_ftelli64(file) > bytes) {
+		ok = _chsize_s(_fileno(file), bytes) == 0;
+	}
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,246 @@
+// metrics.h : low-overhead counters and latency histograms
+//
+// Every thread records into a ThreadMetrics of its own, so the hot path
+// never shares a cache line or takes a lock; a report sums all of them.
+// Each value has a single writer and is updated with relaxed atomic
+// loads and stores, so a report may lag by a few records but never reads
+// a torn value.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+enum MetricsCounter {
+	COUNT_EVENTS,
+	COUNT_MESSAGES,
+	COUNT_TICKS_DECODED,
+	COUNT_TICKS_WRITTEN,
+	COUNT_BYTES_WRITTEN,
+	COUNT_REQUESTS,
+	COUNT_TICKS_UNORDERED,	// -vt: put back in time order
+	COUNT_TICKS_INVALID,	// -vt: dropped, and below
+	COUNT_TICKS_STALE,
+	COUNT_TICKS_DUPLICATE,
+	COUNT_SEND_HOLDS,		// times new requests were held back for the writer
+	COUNT_SEND_HELD_MICROS,	// and for how long, once each hold is over
+	COUNT_RING_FULL_MICROS,	// async: decoding threads waiting on a full ring
+	NUM_METRICS_COUNTERS
+};
+
+enum MetricsHistogram {
+	HIST_FIRST_RESPONSE,	// request sent to first message back, micros
+	HIST_EVENT_WAIT,		// blocked in nextEvent, micros
+	HIST_DECODE,			// decoding one event, micros
+	HIST_WRITE,				// one writer pass over the rings, micros
+	HIST_RING_DEPTH,		// records waiting when the writer looks
+	NUM_METRICS_HISTOGRAMS
+};
+
+// Log-linear buckets in the style of HdrHistogram: exact below 16, then 16
+// sub-buckets per power of two, so any value is placed within about 6%
+class LatencyHistogram {
+
+public:
+
+	enum {
+		SUB_BITS = 4,
+		SUB_BUCKETS = 1 << SUB_BITS,
+		NUM_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS
+	};
+
+	static unsigned bucketOf(uint64_t v)
+	{
+		if (v < SUB_BUCKETS) {
+			return (unsigned)v;
+		}
+		unsigned msb = 0;
+		uint64_t x = v;
+		if (x >> 32) { x >>= 32; msb += 32; }
+		if (x >> 16) { x >>= 16; msb += 16; }
+		if (x >> 8) { x >>= 8; msb += 8; }
+		if (x >> 4) { x >>= 4; msb += 4; }
+		if (x >> 2) { x >>= 2; msb += 2; }
+		if (x >> 1) { msb += 1; }
+		unsigned shift = msb - SUB_BITS;
+		return (shift + 1) * SUB_BUCKETS + (unsigned)((v >> shift) - SUB_BUCKETS);
+	}
+
+	// Smallest value that falls in bucket i
+	static uint64_t bucketFloor(unsigned i)
+	{
+		if (i < 2 * SUB_BUCKETS) {
+			return i;
+		}
+		unsigned shift = i / SUB_BUCKETS - 1;
+		return (uint64_t)(SUB_BUCKETS + i % SUB_BUCKETS) << shift;
+	}
+
+private:
+
+	std::atomic<uint64_t>		d_counts[NUM_BUCKETS];
+	std::atomic<uint64_t>		d_max;
+
+	static void bump(std::atomic<uint64_t> &v, uint64_t n)
+	{
+		v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+public:
+
+	LatencyHistogram()
+	{
+		for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+			d_counts[i].store(0, std::memory_order_relaxed);
+		}
+		d_max.store(0, std::memory_order_relaxed);
+	}
+
+	// Owning thread only
+	void record(uint64_t v)
+	{
+		bump(d_counts[bucketOf(v)], 1);
+		if (v > d_max.load(std::memory_order_relaxed)) {
+			d_max.store(v, std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t count(unsigned bucket) const
+	{
+		return d_counts[bucket].load(std::memory_order_relaxed);
+	}
+
+	uint64_t max() const
+	{
+		return d_max.load(std::memory_order_relaxed);
+	}
+};
+
+// Plain sum of histograms, for reporting
+struct HistogramSnapshot {
+	uint64_t					counts[LatencyHistogram::NUM_BUCKETS];
+	uint64_t					total;
+	uint64_t					max;
+
+	void clear()
+	{
+		for (unsigned i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i) {
+			counts[i] = 0;
+		}
+		total = 0;
+		max = 0;
+	}
+
+	void add(const LatencyHistogram &h)
+	{
+		for (unsigned i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i) {
+			uint64_t n = h.count(i);
+			counts[i] += n;
+			total += n;
+		}
+		if (h.max() > max) {
+			max = h.max();
+		}
+	}
+
+	// Lower bound of the bucket holding the p-th fraction of values
+	uint64_t percentile(double p) const
+	{
+		if (total == 0) {
+			return 0;
+		}
+		uint64_t rank = (uint64_t)(p * (total - 1)) + 1;
+		uint64_t seen = 0;
+		for (unsigned i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i) {
+			seen += counts[i];
+			if (seen >= rank) {
+				uint64_t floor = LatencyHistogram::bucketFloor(i);
+				return floor < max ? floor : max;
+			}
+		}
+		return max;
+	}
+};
+
+struct ThreadMetrics {
+	std::atomic<uint64_t>		counters[NUM_METRICS_COUNTERS];
+	LatencyHistogram			histograms[NUM_METRICS_HISTOGRAMS];
+
+	ThreadMetrics()
+	{
+		for (int i = 0; i < NUM_METRICS_COUNTERS; ++i) {
+			counters[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void add(MetricsCounter c, uint64_t n)
+	{
+		counters[c].store(counters[c].load(std::memory_order_relaxed) + n,
+			std::memory_order_relaxed);
+	}
+
+	void record(MetricsHistogram h, uint64_t v)
+	{
+		histograms[h].record(v);
+	}
+};
+
+// Owns the ThreadMetrics of every thread that has recorded anything.
+// One instance per process: the calling thread's block is cached in a
+// thread_local.
+class Metrics {
+
+	std::mutex					d_mutex;
+	std::vector<ThreadMetrics *>	d_threads;
+
+	Metrics(const Metrics &);
+	Metrics &operator=(const Metrics &);
+
+public:
+
+	Metrics()
+	{
+	}
+
+	~Metrics()
+	{
+		for (size_t i = 0; i < d_threads.size(); ++i) {
+			delete d_threads[i];
+		}
+	}
+
+	ThreadMetrics &local()
+	{
+		static thread_local ThreadMetrics *t_metrics = NULL;
+		if (!t_metrics) {
+			t_metrics = new ThreadMetrics;
+			std::lock_guard<std::mutex> lock(d_mutex);
+			d_threads.push_back(t_metrics);
+		}
+		return *t_metrics;
+	}
+
+	uint64_t counter(MetricsCounter c)
+	{
+		std::lock_guard<std::mutex> lock(d_mutex);
+		uint64_t sum = 0;
+		for (size_t i = 0; i < d_threads.size(); ++i) {
+			sum += d_threads[i]->counters[c].load(std::memory_order_relaxed);
+		}
+		return sum;
+	}
+
+	void histogram(MetricsHistogram h, HistogramSnapshot *out)
+	{
+		out->clear();
+		std::lock_guard<std::mutex> lock(d_mutex);
+		for (size_t i = 0; i < d_threads.size(); ++i) {
+			out->add(d_threads[i]->histograms[h]);
+		}
+	}
+};
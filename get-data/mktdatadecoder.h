@@ -0,0 +1,96 @@
+// mktdatadecoder.h : MarketDataEvents decode for //blp/mktdata subscriptions
+//
+// A subscription update carries the fields that changed, not a tick list.
+// Trades come as MKTDATA_EVENT_TYPE TRADE with LAST_TRADE/SIZE_LAST_TRADE,
+// quotes as QUOTE with subtype BID, ASK or PAIRED and the matching
+// BID/BID_SIZE and ASK/ASK_SIZE. Other updates (summaries, trade
+// corrections and cancels) are skipped.
+//
+// Updates carry no date, so ticks take the time they were received.
+//
+
+#pragma once
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <blpapi_element.h>
+#include <blpapi_name.h>
+
+#include "tickrecord.h"
+
+namespace {
+	const BloombergLP::blpapi::Name MKTDATA_EVENT_TYPE("MKTDATA_EVENT_TYPE");
+	const BloombergLP::blpapi::Name MKTDATA_EVENT_SUBTYPE("MKTDATA_EVENT_SUBTYPE");
+	const BloombergLP::blpapi::Name LAST_TRADE("LAST_TRADE");
+	const BloombergLP::blpapi::Name SIZE_LAST_TRADE("SIZE_LAST_TRADE");
+	const BloombergLP::blpapi::Name BID("BID");
+	const BloombergLP::blpapi::Name ASK("ASK");
+	const BloombergLP::blpapi::Name BID_SIZE("BID_SIZE");
+	const BloombergLP::blpapi::Name ASK_SIZE("ASK_SIZE");
+};
+
+// Subscription fields for TRADE, BID and ASK ticks
+const char *const MKTDATA_FIELDS = "LAST_TRADE,SIZE_LAST_TRADE,BID,ASK,BID_SIZE,ASK_SIZE";
+
+// Bit (1 << TickType) for each type of the list that a subscription can
+// produce
+inline unsigned mktdataTypeMask(const std::vector<std::string> &events)
+{
+	unsigned mask = 0;
+	for (size_t i = 0; i < events.size(); ++i) {
+		TickType type = tickTypeFromString(events[i].c_str());
+		if (type == TICK_TRADE || type == TICK_BID || type == TICK_ASK) {
+			mask |= 1u << type;
+		}
+	}
+	return mask;
+}
+
+template <typename ELEMENT, typename OUT>
+inline bool decodeMktdataField(const ELEMENT &msg, const BloombergLP::blpapi::Name &value,
+	const BloombergLP::blpapi::Name &size, TickRecord &record, OUT &out)
+{
+	if (!msg.hasElement(value, true)) {
+		return false;
+	}
+	record.value = msg.getElementAsFloat64(value);
+	record.size = msg.hasElement(size, true) ? msg.getElementAsInt32(size) : 0;
+	out(record);
+	return true;
+}
+
+// Decodes one update into copies of record (time, chunk and flags already
+// set) for the types in mask, passing each to out(const TickRecord &).
+// Returns the number of ticks.
+template <typename ELEMENT, typename OUT>
+inline size_t decodeMarketData(const ELEMENT &msg, TickRecord record, unsigned mask, OUT &out)
+{
+	if (!msg.hasElement(MKTDATA_EVENT_TYPE, true)) {
+		return 0;
+	}
+	const char *event = msg.getElementAsString(MKTDATA_EVENT_TYPE);
+	const char *subtype = msg.hasElement(MKTDATA_EVENT_SUBTYPE, true)
+		? msg.getElementAsString(MKTDATA_EVENT_SUBTYPE) : "";
+	size_t ticks = 0;
+
+	if (!strcmp(event, "TRADE")) {
+		if ((mask & (1u << TICK_TRADE)) && !strcmp(subtype, "NEW")) {
+			record.type = TICK_TRADE;
+			ticks += decodeMktdataField(msg, LAST_TRADE, SIZE_LAST_TRADE, record, out);
+		}
+	}
+	else if (!strcmp(event, "QUOTE")) {
+		bool paired = !strcmp(subtype, "PAIRED");
+		if ((mask & (1u << TICK_BID)) && (paired || !strcmp(subtype, "BID"))) {
+			record.type = TICK_BID;
+			ticks += decodeMktdataField(msg, BID, BID_SIZE, record, out);
+		}
+		if ((mask & (1u << TICK_ASK)) && (paired || !strcmp(subtype, "ASK"))) {
+			record.type = TICK_ASK;
+			ticks += decodeMktdataField(msg, ASK, ASK_SIZE, record, out);
+		}
+	}
+	return ticks;
+}
@@ -0,0 +1,219 @@
+// requestscheduler.h : pacing and concurrency limit for outgoing requests
+//
+// Two limits apply to every request:
+//
+//   - a token bucket refilled at requestsPerSecond, holding at most one
+//     second's worth, so bursts never exceed the configured rate;
+//   - a concurrency limit between 1 and maxInFlight, adjusted from what the
+//     responses say. It grows by about one request per round of healthy
+//     responses, shrinks by one when time to first response climbs well
+//     above the best seen, and halves on a LIMIT or TIMEOUT error.
+//
+// After a halving, the request rate is halved too and recovers gradually.
+// Not thread safe; callers hold their scheduling lock. Times are in
+// microseconds from any fixed origin.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+class RequestScheduler {
+
+	int							d_maxInFlight;
+	double						d_maxRate;		// requests per second, 0 for no limit
+	double						d_limit;		// current concurrency limit
+	double						d_rate;			// current request rate
+	double						d_tokens;
+	long long					d_lastRefill;
+	int							d_inFlight;
+
+	double						d_latency;		// moving average, seconds
+	double						d_baseline;		// best latency seen, slowly tracking up
+	long long					d_lastBackoff;
+
+	size_t						d_sent;
+	size_t						d_throttled;
+	int							d_lowestLimit;
+
+	static const long long		BACKOFF_HOLD = 1000000;	// one halving per second at most
+
+	void refill(long long now)
+	{
+		if (d_maxRate <= 0) {
+			return;
+		}
+		if (now > d_lastRefill) {
+			const double burst = d_rate < 1 ? 1 : d_rate;
+			d_tokens += d_rate * (now - d_lastRefill) / 1e6;
+			if (d_tokens > burst) {
+				d_tokens = burst;
+			}
+		}
+		d_lastRefill = now;
+	}
+
+	void backoff(long long now)
+	{
+		if (now - d_lastBackoff < BACKOFF_HOLD) {
+			return;
+		}
+		d_lastBackoff = now;
+		d_limit = d_limit / 2 < 1 ? 1 : d_limit / 2;
+		if (d_maxRate > 0) {
+			d_rate = d_rate / 2 < 0.1 ? 0.1 : d_rate / 2;
+			if (d_tokens > d_rate) {
+				d_tokens = d_rate;
+			}
+		}
+		if ((int)d_limit < d_lowestLimit) {
+			d_lowestLimit = (int)d_limit;
+		}
+	}
+
+	void grow()
+	{
+		d_limit += 1.0 / d_limit;
+		if (d_limit > d_maxInFlight) {
+			d_limit = d_maxInFlight;
+		}
+		if (d_maxRate > 0 && d_rate < d_maxRate) {
+			d_rate += d_maxRate / 100;
+			if (d_rate > d_maxRate) {
+				d_rate = d_maxRate;
+			}
+		}
+	}
+
+public:
+
+	RequestScheduler()
+	{
+		configure(50, 0, 0);
+	}
+
+	// Starts at the full concurrency and rate; they only come down once
+	// responses show trouble
+	void configure(int maxInFlight, double requestsPerSecond, long long now)
+	{
+		d_maxInFlight = maxInFlight < 1 ? 1 : maxInFlight;
+		d_maxRate = requestsPerSecond > 0 ? requestsPerSecond : 0;
+		d_limit = d_maxInFlight;
+		d_rate = d_maxRate;
+		d_tokens = d_maxRate > 0 ? 1 : 0;
+		d_lastRefill = now;
+		d_inFlight = 0;
+		d_latency = 0;
+		d_baseline = 0;
+		d_lastBackoff = now - BACKOFF_HOLD;
+		d_sent = 0;
+		d_throttled = 0;
+		d_lowestLimit = d_maxInFlight;
+	}
+
+	bool canSend(long long now)
+	{
+		if (d_inFlight >= (int)d_limit) {
+			return false;
+		}
+		refill(now);
+		return d_maxRate <= 0 || d_tokens >= 1;
+	}
+
+	void onSend()
+	{
+		if (d_maxRate > 0) {
+			d_tokens -= 1;
+		}
+		++d_inFlight;
+		++d_sent;
+	}
+
+	// Microseconds until a token is due, 0 if one is there or there is no
+	// rate limit. Free slots are signalled by responses, not by time.
+	long long waitMicros(long long now)
+	{
+		if (d_maxRate <= 0) {
+			return 0;
+		}
+		refill(now);
+		if (d_tokens >= 1) {
+			return 0;
+		}
+		return (long long)((1 - d_tokens) * 1e6 / d_rate) + 1;
+	}
+
+	// Time from send to the first message of the response
+	void onFirstResponse(double latency)
+	{
+		d_latency = d_latency > 0 ? d_latency * 0.8 + latency * 0.2 : latency;
+		if (d_baseline <= 0 || latency < d_baseline) {
+			d_baseline = latency;
+		}
+		else {
+			d_baseline += (d_latency - d_baseline) * 0.01;
+		}
+
+		if (d_latency > 2 * d_baseline + 0.05) {
+			if (d_limit > 1) {
+				d_limit -= 1;
+			}
+			if ((int)d_limit < d_lowestLimit) {
+				d_lowestLimit = (int)d_limit;
+			}
+		}
+		else {
+			grow();
+		}
+	}
+
+	// Final message of a request; category is the responseError category,
+	// empty on success
+	void onComplete(const char *category, long long now)
+	{
+		if (d_inFlight > 0) {
+			--d_inFlight;
+		}
+		if (!strcmp(category, "LIMIT") || !strcmp(category, "TIMEOUT")) {
+			++d_throttled;
+			backoff(now);
+		}
+	}
+
+	// The session carrying the outstanding requests is gone
+	void abandonInFlight()
+	{
+		d_inFlight = 0;
+	}
+
+	int inFlight() const
+	{
+		return d_inFlight;
+	}
+
+	int limit() const
+	{
+		return (int)d_limit;
+	}
+
+	double rate() const
+	{
+		return d_rate;
+	}
+
+	size_t sent() const
+	{
+		return d_sent;
+	}
+
+	size_t throttled() const
+	{
+		return d_throttled;
+	}
+
+	int lowestLimit() const
+	{
+		return d_lowestLimit;
+	}
+};
@@ -0,0 +1,363 @@
+// sharedticks.h : written ticks published through a named shared-memory
+// ring, for local processes to follow while the scraper runs
+//
+// The scraper's writer thread is the one writer; any number of readers map
+// the same name read-only. The mapping holds
+//
+//   SharedTickHeader   run id, capacity, ticks published so far
+//   names              SHARED_TICK_MAX_SECURITIES fixed-width security names
+//   slots              capacity SharedTickSlots; tick n goes in n % capacity
+//
+// Each slot is a seqlock. Publishing tick n makes the slot's sequence odd,
+// fills the slot in, then sets the sequence to 2n + 2. A reader wanting
+// tick n copies the slot between two reads of the sequence and keeps the
+// copy only if both were 2n + 2; otherwise the writer lapped it and the
+// tick is counted as missed. Readers never write to the mapping, so any
+// number of them cost the writer nothing.
+//
+// A security's name is in place before its first tick is published and
+// never changes. Types and codes are ids, as in bin files: the TickType
+// names, then types.dict and codes.dict in the scraper's output directory.
+//
+
+#pragma once
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "tickrecord.h"
+
+const char SHARED_TICK_MAGIC[4] = { 'T', 'S', 'H', 'M' };
+const uint32_t SHARED_TICK_VERSION = 1;
+const uint32_t SHARED_TICK_MAX_SECURITIES = 16384;	// later ones publish without a name
+const size_t SHARED_TICK_NAME_BYTES = 64;
+const uint32_t SHARED_TICK_CAPACITY = 1 << 20;
+
+struct SharedTickHeader {
+	char						magic[4];
+	uint32_t					version;
+	uint32_t					capacity;		// slots, a power of two
+	uint32_t					securities;		// names
+	std::atomic<uint64_t>		runId;			// new each run, 0 while the ring is being reset
+	std::atomic<uint64_t>		published;		// ticks so far; the next goes in published % capacity
+};
+
+struct SharedTick {
+	int64_t						time;			// epoch nanos, GMT
+	double						value;
+	int32_t						size;
+	uint32_t					security;		// index into the names
+	uint16_t					condition;
+	uint16_t					exchange;
+	uint8_t						type;
+};
+
+struct SharedTickSlot {
+	std::atomic<uint64_t>		sequence;		// odd while being written
+	SharedTick					tick;
+};
+
+inline size_t sharedTickBytes(uint32_t capacity)
+{
+	return sizeof(SharedTickHeader) + SHARED_TICK_MAX_SECURITIES * SHARED_TICK_NAME_BYTES
+		+ (size_t)capacity * sizeof(SharedTickSlot);
+}
+
+class SharedTickPublisher {
+
+	HANDLE						d_mapping;
+	char						*d_view;
+	SharedTickHeader			*d_header;
+	char						*d_names;
+	SharedTickSlot				*d_slots;
+	uint64_t					d_mask;
+	uint64_t					d_next;
+	std::vector<bool>			d_named;		// by security
+
+	SharedTickPublisher(const SharedTickPublisher &);
+	SharedTickPublisher &operator=(const SharedTickPublisher &);
+
+public:
+
+	SharedTickPublisher()
+		: d_mapping(NULL)
+		, d_view(NULL)
+		, d_header(NULL)
+		, d_names(NULL)
+		, d_slots(NULL)
+		, d_mask(0)
+		, d_next(0)
+	{
+	}
+
+	~SharedTickPublisher()
+	{
+		close();
+	}
+
+	// Creates the mapping, or takes over one readers still hold from an
+	// earlier run if its capacity matches; they start over with runId.
+	// capacity is rounded up to a power of two.
+	bool open(const std::string &name, uint32_t capacity, uint64_t runId)
+	{
+		close();
+		uint32_t slots = 2;
+		while (slots < capacity) {
+			slots <<= 1;
+		}
+		uint64_t bytes = sharedTickBytes(slots);
+		d_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD)(bytes >> 32), (DWORD)bytes, name.c_str());
+		if (!d_mapping) {
+			return false;
+		}
+		bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+		d_view = (char *)MapViewOfFile(d_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (size_t)bytes);
+		if (!d_view) {
+			close();
+			return false;
+		}
+		d_header = (SharedTickHeader *)d_view;
+		d_names = d_view + sizeof(SharedTickHeader);
+		d_slots = (SharedTickSlot *)(d_names + SHARED_TICK_MAX_SECURITIES * SHARED_TICK_NAME_BYTES);
+		if (existed && (memcmp(d_header->magic, SHARED_TICK_MAGIC, sizeof(d_header->magic))
+			|| d_header->capacity != slots)) {
+			close();
+			return false;
+		}
+
+		// Readers see runId 0 until the ring is empty again
+		d_header->runId.store(0, std::memory_order_release);
+		d_header->published.store(0, std::memory_order_relaxed);
+		memset(d_names, 0, SHARED_TICK_MAX_SECURITIES * SHARED_TICK_NAME_BYTES);
+		for (uint32_t i = 0; i < slots; ++i) {
+			d_slots[i].sequence.store(0, std::memory_order_relaxed);
+		}
+		memcpy(d_header->magic, SHARED_TICK_MAGIC, sizeof(d_header->magic));
+		d_header->version = SHARED_TICK_VERSION;
+		d_header->capacity = slots;
+		d_header->securities = SHARED_TICK_MAX_SECURITIES;
+		d_header->runId.store(runId ? runId : 1, std::memory_order_release);
+
+		d_mask = slots - 1;
+		d_next = 0;
+		d_named.assign(SHARED_TICK_MAX_SECURITIES, false);
+		return true;
+	}
+
+	void close()
+	{
+		if (d_view) {
+			UnmapViewOfFile(d_view);
+			d_view = NULL;
+		}
+		if (d_mapping) {
+			CloseHandle(d_mapping);
+			d_mapping = NULL;
+		}
+		d_header = NULL;
+	}
+
+	bool isOpen() const
+	{
+		return d_view != NULL;
+	}
+
+	void publish(uint32_t security, const std::string &name, const TickRecord &tick)
+	{
+		if (security < SHARED_TICK_MAX_SECURITIES && !d_named[security]) {
+			char *entry = d_names + security * SHARED_TICK_NAME_BYTES;
+			size_t len = name.size() < SHARED_TICK_NAME_BYTES ? name.size() : SHARED_TICK_NAME_BYTES - 1;
+			memcpy(entry, name.data(), len);
+			d_named[security] = true;
+		}
+
+		const uint64_t n = d_next++;
+		SharedTickSlot &slot = d_slots[n & d_mask];
+		slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.tick.time = tick.time;
+		slot.tick.value = tick.value;
+		slot.tick.size = tick.size;
+		slot.tick.security = security;
+		slot.tick.condition = tick.condition;
+		slot.tick.exchange = tick.exchange;
+		slot.tick.type = tick.type;
+		slot.sequence.store(2 * n + 2, std::memory_order_release);
+		d_header->published.store(n + 1, std::memory_order_release);
+	}
+
+	uint64_t published() const
+	{
+		return d_next;
+	}
+};
+
+// For the processes downstream; one per reading thread
+class SharedTickReader {
+
+	HANDLE						d_mapping;
+	const char					*d_view;
+	const SharedTickHeader		*d_header;
+	const char					*d_names;
+	const SharedTickSlot		*d_slots;
+	uint64_t					d_mask;
+	uint64_t					d_capacity;
+	uint64_t					d_runId;
+	uint64_t					d_next;
+	uint64_t					d_missed;
+
+	SharedTickReader(const SharedTickReader &);
+	SharedTickReader &operator=(const SharedTickReader &);
+
+public:
+
+	SharedTickReader()
+		: d_mapping(NULL)
+		, d_view(NULL)
+		, d_header(NULL)
+		, d_names(NULL)
+		, d_slots(NULL)
+		, d_mask(0)
+		, d_capacity(0)
+		, d_runId(0)
+		, d_next(0)
+		, d_missed(0)
+	{
+	}
+
+	~SharedTickReader()
+	{
+		close();
+	}
+
+	// Fails until a scraper has published under name
+	bool open(const std::string &name)
+	{
+		close();
+		d_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+		if (!d_mapping) {
+			return false;
+		}
+		d_view = (const char *)MapViewOfFile(d_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!d_view) {
+			close();
+			return false;
+		}
+		d_header = (const SharedTickHeader *)d_view;
+		if (memcmp(d_header->magic, SHARED_TICK_MAGIC, sizeof(d_header->magic))
+			|| d_header->version != SHARED_TICK_VERSION) {
+			close();
+			return false;
+		}
+		d_capacity = d_header->capacity;
+		d_mask = d_capacity - 1;
+		d_names = d_view + sizeof(SharedTickHeader);
+		d_slots = (const SharedTickSlot *)(d_names
+			+ (size_t)d_header->securities * SHARED_TICK_NAME_BYTES);
+		d_runId = 0;
+		return true;
+	}
+
+	void close()
+	{
+		if (d_view) {
+			UnmapViewOfFile(d_view);
+			d_view = NULL;
+		}
+		if (d_mapping) {
+			CloseHandle(d_mapping);
+			d_mapping = NULL;
+		}
+		d_header = NULL;
+	}
+
+	// Skip what is there already; the next tick read is the next published
+	void seekLatest()
+	{
+		d_runId = d_header->runId.load(std::memory_order_acquire);
+		d_next = d_header->published.load(std::memory_order_acquire);
+	}
+
+	// The next tick, false if none has been published since. A new run
+	// starts over from its first tick.
+	bool next(SharedTick *tick)
+	{
+		for (;;) {
+			uint64_t runId = d_header->runId.load(std::memory_order_acquire);
+			if (runId == 0) {
+				return false;
+			}
+			if (runId != d_runId) {
+				d_runId = runId;
+				d_next = 0;
+			}
+			uint64_t published = d_header->published.load(std::memory_order_acquire);
+			if (d_next >= published) {
+				return false;
+			}
+			if (published - d_next > d_capacity) {
+				d_missed += published - d_capacity - d_next;
+				d_next = published - d_capacity;
+			}
+
+			const SharedTickSlot &slot = d_slots[d_next & d_mask];
+			const uint64_t expected = 2 * d_next + 2;
+			uint64_t before = slot.sequence.load(std::memory_order_acquire);
+			if (before == expected) {
+				memcpy(tick, &slot.tick, sizeof(*tick));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.sequence.load(std::memory_order_relaxed) == expected) {
+					++d_next;
+					return true;
+				}
+			}
+			// Overwritten before or while it was copied
+			++d_missed;
+			++d_next;
+		}
+	}
+
+	// Empty for securities past the names
+	const char *securityName(uint32_t security) const
+	{
+		return security < d_header->securities ? d_names + security * SHARED_TICK_NAME_BYTES : "";
+	}
+
+	// Ticks the writer overwrote before they were read
+	uint64_t missed() const
+	{
+		return d_missed;
+	}
+};
+
+// Publishes each tick of one security
+class SharedTickSink {
+
+	SharedTickPublisher			*d_publisher;
+	uint32_t					d_security;
+	const std::string			*d_name;
+
+public:
+
+	SharedTickSink(SharedTickPublisher *publisher, uint32_t security, const std::string *name)
+		: d_publisher(publisher)
+		, d_security(security)
+		, d_name(name)
+	{
+	}
+
+	size_t operator()(const TickRecord &tick) const
+	{
+		d_publisher->publish(d_security, *d_name, tick);
+		return 0;
+	}
+};
@@ -0,0 +1,112 @@
+// spscring.h : lock-free single-producer/single-consumer ring buffer
+//
+
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+// Fixed-capacity ring for trivially copyable records. Exactly one thread may
+// push and exactly one (other) thread may pop; neither side ever blocks or
+// takes a lock. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing {
+
+	// Producer and consumer state padded onto separate cache lines so the
+	// two threads do not false-share
+	enum { CACHE_LINE = 64 };
+
+	std::vector<T>				d_slots;
+	size_t						d_mask;
+	char						d_pad0[CACHE_LINE];
+	std::atomic<size_t>			d_head;			// next slot to pop, written by consumer
+	size_t						d_cachedTail;	// consumer's last view of d_tail
+	char						d_pad1[CACHE_LINE];
+	std::atomic<size_t>			d_tail;			// next slot to push, written by producer
+	size_t						d_cachedHead;	// producer's last view of d_head
+	size_t						d_highWater;	// producer only
+	char						d_pad2[CACHE_LINE];
+
+	SpscRing(const SpscRing &);
+	SpscRing &operator=(const SpscRing &);
+
+public:
+
+	explicit SpscRing(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		d_slots.resize(size);
+		d_mask = size - 1;
+		d_head.store(0, std::memory_order_relaxed);
+		d_tail.store(0, std::memory_order_relaxed);
+		d_cachedHead = 0;
+		d_cachedTail = 0;
+		d_highWater = 0;
+	}
+
+	// Producer side; false if the ring is full
+	bool tryPush(const T &item)
+	{
+		const size_t tail = d_tail.load(std::memory_order_relaxed);
+		if (tail - d_cachedHead > d_mask) {
+			d_cachedHead = d_head.load(std::memory_order_acquire);
+			if (tail - d_cachedHead > d_mask) {
+				return false;
+			}
+		}
+		d_slots[tail & d_mask] = item;
+		d_tail.store(tail + 1, std::memory_order_release);
+
+		// Occupancy as last seen by the producer, an upper bound on the truth
+		const size_t used = tail + 1 - d_cachedHead;
+		if (used > d_highWater) {
+			d_highWater = used;
+		}
+		return true;
+	}
+
+	// Consumer side; false if the ring is empty
+	bool tryPop(T *item)
+	{
+		const size_t head = d_head.load(std::memory_order_relaxed);
+		if (head == d_cachedTail) {
+			d_cachedTail = d_tail.load(std::memory_order_acquire);
+			if (head == d_cachedTail) {
+				return false;
+			}
+		}
+		*item = d_slots[head & d_mask];
+		d_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side; records waiting right now
+	size_t size() const
+	{
+		return d_tail.load(std::memory_order_acquire) - d_head.load(std::memory_order_relaxed);
+	}
+
+	// From any thread, e.g. to watch for a writer falling behind. The head
+	// is read first, so the estimate never comes out below zero.
+	size_t sizeFromAnyThread() const
+	{
+		size_t head = d_head.load(std::memory_order_acquire);
+		return d_tail.load(std::memory_order_acquire) - head;
+	}
+
+	size_t capacity() const
+	{
+		return d_mask + 1;
+	}
+
+	// Read once the producer has stopped
+	size_t highWaterMark() const
+	{
+		return d_highWater;
+	}
+};
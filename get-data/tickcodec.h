@@ -0,0 +1,306 @@
+// tickcodec.h : per-block encoding of the tick columns for packed bin
+// blocks
+//
+// Each column is encoded on its own, one after the other:
+//
+//   time       first as is, then the change in spacing (delta of delta)
+//              in the block's time unit, zigzag varints; evenly spaced
+//              ticks take a byte each
+//   value      with a decimal scale, the change in value * 10^scale as
+//              zigzag varints shifted up a bit, or a 1 and the value's 8
+//              bytes for the odd value not exact at that scale; without,
+//              each value's bits XOR the last value's, as a byte of
+//              (leading zero bytes << 4 | kept bytes) and the kept bytes
+//   size       zigzag varints
+//   type       a byte each
+//   condition  varints, codes blocks only
+//   exchange   varints, codes blocks only
+//
+// The time unit is the largest power of ten nanos, up to a second, that
+// every time in the block is a whole number of from the first; ticks
+// stamped to the millisecond get 10^6. The value scale is the smallest of
+// 0..MAX_DECIMAL_SCALE at which every value in the block is an exact
+// decimal, bar about 1%, checked so that decoding gives back the same
+// bits. Prices quoted in ticks and cents almost always have one.
+//
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace tickcodec {
+
+	const int MAX_DECIMAL_SCALE = 8;
+
+	const double POW10[MAX_DECIMAL_SCALE + 1] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8
+	};
+
+	const int MAX_TIME_UNIT = 9;
+
+	const int64_t TIME_UNITS[MAX_TIME_UNIT + 1] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+	};
+
+	inline uint64_t zigzag(int64_t v)
+	{
+		return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+	}
+
+	inline int64_t unzigzag(uint64_t v)
+	{
+		return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+	}
+
+	inline void putVarint(std::vector<char> &out, uint64_t v)
+	{
+		while (v >= 0x80) {
+			out.push_back((char)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((char)v);
+	}
+
+	// false on running off the end or more than 64 bits
+	inline bool getVarint(const char *&p, const char *end, uint64_t *v)
+	{
+		uint64_t result = 0;
+		for (int shift = 0; shift < 64 && p < end; shift += 7) {
+			uint8_t byte = (uint8_t)*p++;
+			result |= (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				*v = result;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline uint64_t doubleBits(double v)
+	{
+		uint64_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		return bits;
+	}
+
+	inline double bitsDouble(uint64_t bits)
+	{
+		double v;
+		memcpy(&v, &bits, sizeof(v));
+		return v;
+	}
+
+	inline bool exactAtScale(double v, int scale, int64_t *scaled)
+	{
+		double s = v * POW10[scale];
+		if (!(fabs(s) < 9007199254740992.0)) {		// 2^53, NaN fails too
+			return false;
+		}
+		int64_t n = llround(s);
+		if (doubleBits((double)n / POW10[scale]) != doubleBits(v)) {
+			return false;
+		}
+		*scaled = n;
+		return true;
+	}
+
+	// Smallest scale within 1% of the most values any scale makes exact,
+	// -1 if even that is under half of them
+	inline int decimalScale(const double *values, uint32_t count)
+	{
+		uint32_t exact[MAX_DECIMAL_SCALE + 1] = { 0 };
+		int64_t scaled;
+		for (uint32_t i = 0; i < count; ++i) {
+			for (int scale = 0; scale <= MAX_DECIMAL_SCALE; ++scale) {
+				if (exactAtScale(values[i], scale, &scaled)) {
+					++exact[scale];
+					break;
+				}
+			}
+		}
+		for (int scale = 1; scale <= MAX_DECIMAL_SCALE; ++scale) {
+			exact[scale] += exact[scale - 1];
+		}
+		uint64_t most = exact[MAX_DECIMAL_SCALE];
+		if (most * 2 < count) {
+			return -1;
+		}
+		int scale = 0;
+		while ((uint64_t)exact[scale] * 100 < most * 99) {
+			++scale;
+		}
+		return scale;
+	}
+
+	// Largest unit, as a power of ten nanos, that divides every time's
+	// distance from the first
+	inline int timeUnit(const int64_t *times, uint32_t count)
+	{
+		int unit = MAX_TIME_UNIT;
+		for (uint32_t i = 1; i < count && unit > 0; ++i) {
+			while (unit > 0 && (times[i] - times[0]) % TIME_UNITS[unit]) {
+				--unit;
+			}
+		}
+		return unit;
+	}
+
+	// unit from timeUnit
+	inline void packTimes(const int64_t *times, uint32_t count, int unit, std::vector<char> &out)
+	{
+		int64_t last = 0, lastDelta = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (i == 0) {
+				putVarint(out, zigzag(times[0]));
+				continue;
+			}
+			int64_t offset = (times[i] - times[0]) / TIME_UNITS[unit];
+			int64_t delta = offset - last;
+			putVarint(out, zigzag(delta - lastDelta));
+			last = offset;
+			lastDelta = delta;
+		}
+	}
+
+	inline bool unpackTimes(const char *&p, const char *end, uint32_t count, int unit,
+		int64_t *times)
+	{
+		if (unit < 0 || unit > MAX_TIME_UNIT) {
+			return false;
+		}
+		int64_t last = 0, lastDelta = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			uint64_t v;
+			if (!getVarint(p, end, &v)) {
+				return false;
+			}
+			if (i == 0) {
+				times[0] = unzigzag(v);
+				continue;
+			}
+			lastDelta += unzigzag(v);
+			last += lastDelta;
+			times[i] = times[0] + last * TIME_UNITS[unit];
+		}
+		return true;
+	}
+
+	// scale from decimalScale
+	inline void packValues(const double *values, uint32_t count, int scale, std::vector<char> &out)
+	{
+		if (scale >= 0) {
+			int64_t last = 0, scaled;
+			for (uint32_t i = 0; i < count; ++i) {
+				if (exactAtScale(values[i], scale, &scaled)) {
+					putVarint(out, zigzag(scaled - last) << 1);
+					last = scaled;
+					continue;
+				}
+				uint64_t bits = doubleBits(values[i]);
+				out.push_back(1);
+				for (int b = 0; b < 8; ++b) {
+					out.push_back((char)(bits >> (8 * b)));
+				}
+			}
+			return;
+		}
+		uint64_t last = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			uint64_t bits = doubleBits(values[i]);
+			uint64_t x = bits ^ last;
+			last = bits;
+			int lead = 0, trail = 0;
+			if (x) {
+				while (lead < 7 && !(x >> (56 - 8 * lead))) {
+					++lead;
+				}
+				while (!((x >> (8 * trail)) & 0xff)) {
+					++trail;
+				}
+			}
+			int kept = x ? 8 - lead - trail : 0;
+			out.push_back((char)(lead << 4 | kept));
+			for (int b = kept - 1; b >= 0; --b) {
+				out.push_back((char)(x >> (8 * (trail + b))));
+			}
+		}
+	}
+
+	inline bool unpackValues(const char *&p, const char *end, uint32_t count, int scale,
+		double *values)
+	{
+		if (scale > MAX_DECIMAL_SCALE) {
+			return false;
+		}
+		if (scale >= 0) {
+			int64_t last = 0;
+			for (uint32_t i = 0; i < count; ++i) {
+				uint64_t v;
+				if (!getVarint(p, end, &v)) {
+					return false;
+				}
+				if (v & 1) {
+					if (end - p < 8) {
+						return false;
+					}
+					uint64_t bits = 0;
+					for (int b = 0; b < 8; ++b) {
+						bits |= (uint64_t)(uint8_t)*p++ << (8 * b);
+					}
+					values[i] = bitsDouble(bits);
+					continue;
+				}
+				last += unzigzag(v >> 1);
+				values[i] = (double)last / POW10[scale];
+			}
+			return true;
+		}
+		uint64_t last = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (p >= end) {
+				return false;
+			}
+			uint8_t control = (uint8_t)*p++;
+			int lead = control >> 4, kept = control & 0x0f;
+			if (lead + kept > 8 || end - p < kept) {
+				return false;
+			}
+			uint64_t x = 0;
+			for (int b = 0; b < kept; ++b) {
+				x = x << 8 | (uint8_t)*p++;
+			}
+			if (kept) {
+				x <<= 8 * (8 - lead - kept);
+			}
+			last ^= x;
+			values[i] = bitsDouble(last);
+		}
+		return true;
+	}
+
+	template <typename T>
+	inline void packVarints(const T *column, uint32_t count, bool signedValues,
+		std::vector<char> &out)
+	{
+		for (uint32_t i = 0; i < count; ++i) {
+			putVarint(out, signedValues ? zigzag((int64_t)column[i]) : (uint64_t)column[i]);
+		}
+	}
+
+	template <typename T>
+	inline bool unpackVarints(const char *&p, const char *end, uint32_t count, bool signedValues,
+		T *column)
+	{
+		for (uint32_t i = 0; i < count; ++i) {
+			uint64_t v;
+			if (!getVarint(p, end, &v)) {
+				return false;
+			}
+			column[i] = signedValues ? (T)unzigzag(v) : (T)v;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,168 @@
+// tickdecoder.h : tickData decode loop shared by the scraper and benchmarks
+//
+// The loop is a template over the Element type so that the benchmarks can
+// feed it synthetic fixtures with the same accessors as blpapi::Element.
+//
+
+#pragma once
+
+#include <blpapi_datetime.h>
+#include <blpapi_element.h>
+#include <blpapi_name.h>
+
+#include "timeutil.h"
+#include "tickrecord.h"
+#include "interntable.h"
+
+namespace {
+	const BloombergLP::blpapi::Name TICK_DATA("tickData");
+	const BloombergLP::blpapi::Name TICK_SIZE("size");
+	const BloombergLP::blpapi::Name TIME("time");
+	const BloombergLP::blpapi::Name TYPE("type");
+	const BloombergLP::blpapi::Name VALUE("value");
+	const BloombergLP::blpapi::Name CONDITION_CODES("conditionCodes");
+	const BloombergLP::blpapi::Name EXCHANGE_CODE("exchangeCode");
+};
+
+inline long long datetimeToEpoch(const BloombergLP::blpapi::Datetime &dt)
+{
+	return timeutil::toEpoch(dt.year(), dt.month(), dt.day(),
+		dt.hours(), dt.minutes(), dt.seconds());
+}
+
+inline long long datetimeToEpochNanos(const BloombergLP::blpapi::Datetime &dt)
+{
+	return datetimeToEpoch(dt) * timeutil::NANOS_PER_SECOND
+		+ (long long)dt.milliseconds() * 1000000;
+}
+
+// Positions of the tick fields within a tickData item, resolved once per
+// message so the per-tick loop does no Name lookups
+struct TickFieldPositions {
+	size_t						numElements;
+	size_t						time;
+	size_t						type;
+	size_t						value;
+	size_t						size;
+	size_t						condition;		// NOT_FOUND if not requested
+	size_t						exchange;
+};
+
+template <typename ITEM>
+inline bool resolveTickFields(const ITEM &item, TickFieldPositions *pos)
+{
+	const size_t NOT_FOUND = (size_t)-1;
+	pos->numElements = item.numElements();
+	pos->time = pos->type = pos->value = pos->size = NOT_FOUND;
+	pos->condition = pos->exchange = NOT_FOUND;
+	for (size_t j = 0; j < pos->numElements; ++j) {
+		BloombergLP::blpapi::Name name = item.getElement(j).name();
+		if (name == TIME) {
+			pos->time = j;
+		}
+		else if (name == TYPE) {
+			pos->type = j;
+		}
+		else if (name == VALUE) {
+			pos->value = j;
+		}
+		else if (name == TICK_SIZE) {
+			pos->size = j;
+		}
+		else if (name == CONDITION_CODES) {
+			pos->condition = j;
+		}
+		else if (name == EXCHANGE_CODE) {
+			pos->exchange = j;
+		}
+	}
+	return pos->time != NOT_FOUND && pos->type != NOT_FOUND
+		&& pos->value != NOT_FOUND && pos->size != NOT_FOUND;
+}
+
+template <typename ITEM>
+inline unsigned short findCode(const ITEM &item, const BloombergLP::blpapi::Name &name,
+	InternCache *codes)
+{
+	return item.hasElement(name) ? (unsigned short)codes->intern(item.getElementAsString(name)) : 0;
+}
+
+// The code at position if it is there, as in the first item; items
+// carrying only some of the optional codes may have it elsewhere
+template <typename ITEM>
+inline unsigned short decodeCode(const ITEM &item, size_t position,
+	const BloombergLP::blpapi::Name &name, InternCache *codes)
+{
+	if (position == (size_t)-1) {
+		return 0;
+	}
+	auto field = item.getElement(position);
+	if (field.name() == name) {
+		return (unsigned short)codes->intern(field.getValueAsString());
+	}
+	return findCode(item, name, codes);
+}
+
+// TickType of name; with types, names past the TickType ones get ids of
+// their own rather than TICK_UNKNOWN
+inline unsigned char decodeTickType(const char *name, InternCache *types)
+{
+	TickType type = tickTypeFromString(name);
+	if (type == TICK_UNKNOWN && types) {
+		return (unsigned char)types->intern(name);
+	}
+	return (unsigned char)type;
+}
+
+// Decodes every item of the inner tickData array into a copy of record
+// (chunk and flags already set) and passes it to out(const TickRecord &).
+// Nothing in the per-tick loop allocates: time is decoded as a Datetime
+// and type is matched against the static type names in place. Condition
+// and exchange codes, and unknown types, are interned through the caches
+// in interning, if any; items without codes get 0.
+template <typename DATA, typename OUT>
+inline void decodeTickData(const DATA &data, TickRecord record, OUT &out,
+	const TickInterning *interning = NULL)
+{
+	static const TickInterning NONE = { NULL, NULL, NULL };
+	const TickInterning &caches = interning ? *interning : NONE;
+	const size_t numItems = data.numValues();
+	record.condition = 0;
+	record.exchange = 0;
+	if (numItems == 0) {
+		return;
+	}
+
+	TickFieldPositions pos;
+	bool positional = resolveTickFields(data.getValueAsElement(0), &pos);
+
+	for (size_t i = 0; i < numItems; ++i) {
+		auto item = data.getValueAsElement(i);
+
+		if (positional && item.numElements() == pos.numElements) {
+			record.time = datetimeToEpochNanos(item.getElement(pos.time).getValueAsDatetime());
+			record.type = decodeTickType(item.getElement(pos.type).getValueAsString(), caches.types);
+			record.value = item.getElement(pos.value).getValueAsFloat64();
+			record.size = item.getElement(pos.size).getValueAsInt32();
+			if (caches.conditions) {
+				record.condition = decodeCode(item, pos.condition, CONDITION_CODES, caches.conditions);
+			}
+			if (caches.exchanges) {
+				record.exchange = decodeCode(item, pos.exchange, EXCHANGE_CODE, caches.exchanges);
+			}
+		}
+		else {
+			record.time = datetimeToEpochNanos(item.getElementAsDatetime(TIME));
+			record.type = decodeTickType(item.getElementAsString(TYPE), caches.types);
+			record.value = item.getElementAsFloat64(VALUE);
+			record.size = item.getElementAsInt32(TICK_SIZE);
+			if (caches.conditions) {
+				record.condition = findCode(item, CONDITION_CODES, caches.conditions);
+			}
+			if (caches.exchanges) {
+				record.exchange = findCode(item, EXCHANGE_CODE, caches.exchanges);
+			}
+		}
+		out(record);
+	}
+}
@@ -0,0 +1,64 @@
+// tickrecord.h : fixed-size tick record passed from decoder to writer
+//
+
+#pragma once
+
+#include <string.h>
+
+// IntradayTickRequest eventTypes
+enum TickType {
+	TICK_TRADE,
+	TICK_BID,
+	TICK_ASK,
+	TICK_BID_BEST,
+	TICK_ASK_BEST,
+	TICK_MID_PRICE,
+	TICK_AT_TRADE,
+	TICK_BEST_BID,
+	TICK_BEST_ASK,
+	TICK_SETTLE,
+	TICK_UNKNOWN,
+	NUM_TICK_TYPES
+};
+
+namespace {
+	const char *const TICK_TYPE_NAMES[NUM_TICK_TYPES] = {
+		"TRADE", "BID", "ASK", "BID_BEST", "ASK_BEST", "MID_PRICE",
+		"AT_TRADE", "BEST_BID", "BEST_ASK", "SETTLE", "UNKNOWN"
+	};
+};
+
+inline TickType tickTypeFromString(const char *name)
+{
+	for (int i = 0; i < TICK_UNKNOWN; ++i) {
+		if (!strcmp(name, TICK_TYPE_NAMES[i])) {
+			return (TickType)i;
+		}
+	}
+	return TICK_UNKNOWN;
+}
+
+inline const char *tickTypeName(int type)
+{
+	return type >= 0 && type < NUM_TICK_TYPES ? TICK_TYPE_NAMES[type] : "UNKNOWN";
+}
+
+// Record flags; a flagged record carries no tick, except TICK_STREAMED
+enum {
+	TICK_END_OF_REQUEST = 1,	// final message of the chunk's request
+	TICK_REQUEST_FAILED = 2,
+	TICK_REQUEST_RETRIED = 4,	// request failed and is sent again for what is missing
+	TICK_STREAMED = 8			// subscription tick; chunk holds the security index
+};
+
+// POD so it can be copied through SpscRing slots
+struct TickRecord {
+	long long					time;		// epoch nanos, GMT
+	double						value;
+	int							size;
+	unsigned					chunk;		// index into d_chunks, see TICK_STREAMED
+	unsigned char				type;		// TickType
+	unsigned char				flags;
+	unsigned short				condition;	// CodeTable id, 0 if none
+	unsigned short				exchange;	// CodeTable id, 0 if none
+};
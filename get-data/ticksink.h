@@ -0,0 +1,134 @@
+// ticksink.h : per-tick output policies the writer is compiled for
+//
+// A sink is a small copyable function object,
+//
+//   size_t operator()(const TickRecord &tick)
+//
+// returning the bytes it wrote. The writer is a template over its output,
+// builds the sink for a security's open file and calls it for each tick,
+// so the format is fixed at compile time and inlined: no virtual call and
+// no check of -o per tick. TeeSink runs two sinks on every tick and nests,
+// e.g. bin files plus bars. NullSink takes ticks and writes nothing, for
+// measuring everything before the files.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+#include "baraggregator.h"
+#include "binsink.h"
+#include "csvsink.h"
+#include "interntable.h"
+#include "tickrecord.h"
+
+struct NullSink {
+	size_t operator()(const TickRecord &) const
+	{
+		return 0;
+	}
+};
+
+// Rows end in condition,exchange with CODES
+template <bool CODES>
+class CsvTickSink {
+
+	CsvSink						*d_file;		// NULL if it failed to open
+	const InternTable			*d_types;
+
+public:
+
+	CsvTickSink(CsvSink *file, const InternTable *types)
+		: d_file(file)
+		, d_types(types)
+	{
+	}
+
+	size_t operator()(const TickRecord &tick) const
+	{
+		if (!d_file) {
+			return 0;
+		}
+		std::string interned;
+		const char *type = tickTypeName(tick.type, *d_types, interned);
+		return CODES
+			? d_file->writeRow(tick.time, type, tick.value, tick.size, tick.condition, tick.exchange)
+			: d_file->writeRow(tick.time, type, tick.value, tick.size);
+	}
+};
+
+// CODES for files with enableCodes, which store both columns
+template <bool CODES>
+class BinTickSink {
+
+	BinSink						*d_file;		// NULL if it failed to open
+
+public:
+
+	explicit BinTickSink(BinSink *file)
+		: d_file(file)
+	{
+	}
+
+	size_t operator()(const TickRecord &tick) const
+	{
+		if (!d_file) {
+			return 0;
+		}
+		d_file->writeTick(tick.time, tick.type, tick.value, tick.size, tick.condition,
+			tick.exchange);
+		return TICK_BYTES + (CODES ? TICK_CODE_BYTES : 0);
+	}
+};
+
+// Adds each tick to bars, passing those it closes to out(int type,
+// const Bar &)
+template <typename OUT>
+class BarTickSink {
+
+	BarAggregator				*d_bars;
+	OUT							d_out;
+
+public:
+
+	BarTickSink(BarAggregator *bars, const OUT &out)
+		: d_bars(bars)
+		, d_out(out)
+	{
+	}
+
+	size_t operator()(const TickRecord &tick)
+	{
+		d_bars->add(tick, d_out);
+		return 0;
+	}
+};
+
+// first, then second
+template <typename FIRST, typename SECOND>
+class TeeSink {
+
+	FIRST						d_first;
+	SECOND						d_second;
+
+public:
+
+	TeeSink(const FIRST &first, const SECOND &second)
+		: d_first(first)
+		, d_second(second)
+	{
+	}
+
+	size_t operator()(const TickRecord &tick)
+	{
+		size_t bytes = d_first(tick);
+		return bytes + d_second(tick);
+	}
+};
+
+template <typename FIRST, typename SECOND>
+inline TeeSink<FIRST, SECOND> tee(const FIRST &first, const SECOND &second)
+{
+	return TeeSink<FIRST, SECOND>(first, second);
+}
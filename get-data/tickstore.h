@@ -0,0 +1,359 @@
+// tickstore.h : memory-mapped reads of binary tick files, with a time index
+// for range queries
+//
+// The files BinSink writes are the store: append-only blocks whose headers
+// carry their time range. Opening a file maps it read-only and walks the
+// block headers, one per blockCapacity ticks, into a sparse index. A range
+// query binary-searches the index for the first block that can hold the
+// start, then that block's time column for the first tick, and walks
+// forward until the end; pages outside the range are never touched.
+//
+// Searching needs ticks in time order. Version 3 files keep each block in
+// order; the index is searched only if, on top of that, no block starts
+// before the previous one ends, which a rerun appending an overlapping
+// range breaks. Other files fall back to visiting every block whose range
+// overlaps the query.
+//
+// Packed (TBLZ) blocks are indexed the same way from their headers and
+// decoded only when a query reaches them, into columns the reader keeps,
+// so at most one block is held decoded at a time.
+//
+
+#pragma once
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "binsink.h"
+
+// Read-only view of a whole file
+class MappedFile {
+
+	HANDLE						d_file;
+	HANDLE						d_mapping;
+	const char					*d_data;
+	size_t						d_size;
+
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+public:
+
+	MappedFile()
+		: d_file(INVALID_HANDLE_VALUE)
+		, d_mapping(NULL)
+		, d_data(NULL)
+		, d_size(0)
+	{
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	// Fails for empty files, which cannot be mapped
+	bool open(const std::string &path)
+	{
+		close();
+		d_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (d_file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(d_file, &size) || size.QuadPart == 0) {
+			close();
+			return false;
+		}
+		d_mapping = CreateFileMappingA(d_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (d_mapping) {
+			d_data = (const char *)MapViewOfFile(d_mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		if (!d_data) {
+			close();
+			return false;
+		}
+		d_size = (size_t)size.QuadPart;
+		return true;
+	}
+
+	void close()
+	{
+		if (d_data) {
+			UnmapViewOfFile(d_data);
+			d_data = NULL;
+		}
+		if (d_mapping) {
+			CloseHandle(d_mapping);
+			d_mapping = NULL;
+		}
+		if (d_file != INVALID_HANDLE_VALUE) {
+			CloseHandle(d_file);
+			d_file = INVALID_HANDLE_VALUE;
+		}
+		d_size = 0;
+	}
+
+	const char *data() const { return d_data; }
+	size_t size() const { return d_size; }
+};
+
+// The columns of one block, in place in the mapping or, for packed blocks,
+// in the reader once decoded
+struct TickBlockView {
+	int64_t						minTime;
+	int64_t						maxTime;
+	uint32_t					count;
+	const int64_t				*times;
+	const double				*values;
+	const int32_t				*sizes;
+	const uint8_t				*types;
+	const uint16_t				*conditions;	// NULL in TBLK blocks
+	const uint16_t				*exchanges;
+	const char					*packed;		// TBLZ blocks only, else NULL
+	TickPackedHeader			packing;
+};
+
+class TickFileReader {
+
+	MappedFile					d_map;
+	std::vector<TickBlockView>	d_blocks;		// the index, in file order
+	uint32_t					d_version;
+	bool						d_sortedBlocks;	// each block in time order
+	bool						d_ordered;		// and the blocks too
+	size_t						d_ticks;
+
+	// The packed block last decoded and its columns
+	mutable size_t					d_decoded;
+	mutable TickBlockView			d_decodedView;
+	mutable std::vector<int64_t>	d_times;
+	mutable std::vector<double>		d_values;
+	mutable std::vector<int32_t>	d_sizes;
+	mutable std::vector<uint16_t>	d_conditions;
+	mutable std::vector<uint16_t>	d_exchanges;
+
+	TickFileReader(const TickFileReader &);
+	TickFileReader &operator=(const TickFileReader &);
+
+	static bool startsBefore(const TickBlockView &block, int64_t time)
+	{
+		return block.maxTime < time;
+	}
+
+	// Columns of packed block b, NULL if it does not decode
+	const TickBlockView *decode(size_t b) const
+	{
+		if (d_decoded == b) {
+			return &d_decodedView;
+		}
+		const TickBlockView &block = d_blocks[b];
+		const uint32_t count = block.count;
+		const bool codes = (block.packing.flags & TICK_PACKED_CODES) != 0;
+		int scale = block.packing.flags & TICK_PACKED_DECIMAL
+			? (int)(block.packing.flags >> 8 & 0xff) : -1;
+		int unit = (int)(block.packing.flags >> 16 & 0xff);
+		d_times.resize(count);
+		d_values.resize(count);
+		d_sizes.resize(count);
+		d_conditions.resize(codes ? count : 0);
+		d_exchanges.resize(codes ? count : 0);
+
+		const char *p = block.packed;
+		const char *end = p + block.packing.bytes;
+		d_decoded = (size_t)-1;
+		if (!count
+			|| !tickcodec::unpackTimes(p, end, count, unit, &d_times[0])
+			|| !tickcodec::unpackValues(p, end, count, scale, &d_values[0])
+			|| !tickcodec::unpackVarints(p, end, count, true, &d_sizes[0])
+			|| (size_t)(end - p) < count) {
+			return NULL;
+		}
+		d_decodedView = block;
+		d_decodedView.times = &d_times[0];
+		d_decodedView.values = &d_values[0];
+		d_decodedView.sizes = &d_sizes[0];
+		d_decodedView.types = (const uint8_t *)p;
+		p += count;
+		if (codes) {
+			if (!tickcodec::unpackVarints(p, end, count, false, &d_conditions[0])
+				|| !tickcodec::unpackVarints(p, end, count, false, &d_exchanges[0])) {
+				return NULL;
+			}
+			d_decodedView.conditions = &d_conditions[0];
+			d_decodedView.exchanges = &d_exchanges[0];
+		}
+		d_decoded = b;
+		return &d_decodedView;
+	}
+
+public:
+
+	TickFileReader()
+		: d_version(0)
+		, d_sortedBlocks(false)
+		, d_ordered(false)
+		, d_ticks(0)
+		, d_decoded((size_t)-1)
+	{
+	}
+
+	// Maps path and indexes its blocks. A torn block at the end, from a
+	// crash mid-write, is left out.
+	bool open(const std::string &path)
+	{
+		close();
+		if (!d_map.open(path) || d_map.size() < sizeof(TickFileHeader)) {
+			return false;
+		}
+		const char *data = d_map.data();
+		const TickFileHeader *file = (const TickFileHeader *)data;
+		if (memcmp(file->magic, TICK_FILE_MAGIC, sizeof(file->magic))
+			|| file->version == 0 || file->version > TICK_FILE_VERSION) {
+			close();
+			return false;
+		}
+		d_version = file->version;
+		d_sortedBlocks = d_version >= 3;
+		d_ordered = d_sortedBlocks;
+
+		size_t offset = sizeof(TickFileHeader);
+		while (offset + sizeof(TickBlockHeader) <= d_map.size()) {
+			const TickBlockHeader *header = (const TickBlockHeader *)(data + offset);
+			const char *column = data + offset + sizeof(TickBlockHeader);
+			TickBlockView block;
+			memset(&block, 0, sizeof(block));
+			block.minTime = header->minTime;
+			block.maxTime = header->maxTime;
+			block.count = header->count;
+
+			if (!memcmp(header->magic, TICK_PACKED_BLOCK_MAGIC, sizeof(header->magic))) {
+				if (offset + sizeof(TickBlockHeader) + sizeof(TickPackedHeader) > d_map.size()) {
+					break;
+				}
+				memcpy(&block.packing, column, sizeof(block.packing));
+				size_t bytes = tickPackedBlockBytes(block.packing.bytes);
+				if (offset + bytes > d_map.size()) {
+					break;
+				}
+				block.packed = column + sizeof(TickPackedHeader);
+				addBlock(block);
+				offset += bytes;
+				continue;
+			}
+			bool codes = !memcmp(header->magic, TICK_CODES_BLOCK_MAGIC, sizeof(header->magic));
+			if (!codes && memcmp(header->magic, TICK_BLOCK_MAGIC, sizeof(header->magic))) {
+				break;
+			}
+			size_t bytes = tickBlockBytes(header->count, codes);
+			if (offset + bytes > d_map.size()) {
+				break;
+			}
+
+			block.times = (const int64_t *)column;
+			column += (size_t)block.count * sizeof(int64_t);
+			block.values = (const double *)column;
+			column += (size_t)block.count * sizeof(double);
+			block.sizes = (const int32_t *)column;
+			column += (size_t)block.count * sizeof(int32_t);
+			block.types = (const uint8_t *)column;
+			column += block.count;
+			if (codes) {
+				block.conditions = (const uint16_t *)column;
+				block.exchanges = block.conditions + block.count;
+			}
+			addBlock(block);
+			offset += bytes;
+		}
+		return true;
+	}
+
+	void addBlock(const TickBlockView &block)
+	{
+		if (!d_blocks.empty() && block.minTime < d_blocks.back().maxTime) {
+			d_ordered = false;
+		}
+		d_blocks.push_back(block);
+		d_ticks += block.count;
+	}
+
+	void close()
+	{
+		d_map.close();
+		d_blocks.clear();
+		d_version = 0;
+		d_ticks = 0;
+		d_decoded = (size_t)-1;
+	}
+
+	size_t blocks() const { return d_blocks.size(); }
+	size_t ticks() const { return d_ticks; }
+
+	// Packed blocks are decoded first, replacing the last one decoded;
+	// NULL if a packed block is corrupt
+	const TickBlockView *block(size_t i) const
+	{
+		return d_blocks[i].packed ? decode(i) : &d_blocks[i];
+	}
+
+	// Whether queries binary-search rather than visit each block
+	bool ordered() const { return d_ordered; }
+
+	// out(const TickBlockView &, uint32_t index) for each tick with
+	// start <= time < end, in file order. Returns the number of ticks.
+	// Corrupt packed blocks are skipped.
+	template <typename OUT>
+	size_t query(int64_t start, int64_t end, OUT &out) const
+	{
+		size_t b = 0;
+		if (d_ordered) {
+			b = std::lower_bound(d_blocks.begin(), d_blocks.end(), start, startsBefore)
+				- d_blocks.begin();
+		}
+		size_t matched = 0;
+		for (; b < d_blocks.size(); ++b) {
+			const TickBlockView &entry = d_blocks[b];
+			if (entry.minTime >= end) {
+				if (d_ordered) {
+					break;
+				}
+				continue;
+			}
+			if (entry.maxTime < start) {
+				continue;
+			}
+			const TickBlockView *view = block(b);
+			if (!view) {
+				continue;
+			}
+			const TickBlockView &block = *view;
+			uint32_t i = 0;
+			if (d_sortedBlocks) {
+				i = (uint32_t)(std::lower_bound(block.times, block.times + block.count, start)
+					- block.times);
+			}
+			for (; i < block.count; ++i) {
+				int64_t time = block.times[i];
+				if (time >= end) {
+					if (d_sortedBlocks) {
+						break;
+					}
+					continue;
+				}
+				if (time >= start) {
+					out(block, i);
+					++matched;
+				}
+			}
+		}
+		return matched;
+	}
+};
@@ -0,0 +1,177 @@
+// tickvalidator.h : drops bad, stale and repeated ticks from a decoded
+// batch before they reach the writer
+//
+// A batch is one message's ticks, as columns, so that each check is a
+// branch-free loop over one or two arrays that the compiler vectorizes:
+//
+//   unordered  earlier than the tick before it; a batch with any is put
+//              back in time order, keeping the order of equal times
+//   invalid    NaN value, or size 0 or less
+//   stale      earlier than the last tick kept from the chunk's previous
+//              batch, as when a response overlaps what was already taken
+//   duplicate  at the time of the previous batch's last kept tick and at
+//              or before a repeat of it: the overlap a re-sent or appended
+//              response carries. Repeats within a batch are kept, as
+//              back-to-back prints of the same price and size are real
+//
+// Each tick counts once, under the first of invalid, stale and duplicate
+// that drops it. Batches are checked on the decoding threads, in parallel
+// across them; all a chunk carries from one batch to the next is its
+// TickBoundary.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "tickrecord.h"
+
+struct TickColumns {
+	uint32_t					count;
+	const int64_t				*times;
+	const double				*values;
+	const int32_t				*sizes;
+	const uint8_t				*types;
+	const uint16_t				*conditions;
+	const uint16_t				*exchanges;
+};
+
+// The last tick kept from a chunk's previous batch
+struct TickBoundary {
+	bool						valid;			// false until a tick is kept
+	int64_t						time;
+	double						value;
+	int32_t						size;
+	uint8_t						type;
+	uint16_t					condition;
+	uint16_t					exchange;
+};
+
+struct TickValidation {
+	const uint32_t				*order;			// batch index of each tick in time order, NULL if in order already
+	const uint8_t				*keep;			// 1 for each tick kept, by position in time order
+	uint32_t					kept;
+	uint32_t					unordered;
+	uint32_t					invalid;
+	uint32_t					stale;
+	uint32_t					duplicate;
+};
+
+// Columns of records, in scratch
+inline TickColumns splitTicks(const TickRecord *ticks, uint32_t count, Arena &scratch)
+{
+	int64_t *times = scratch.allocate<int64_t>(count);
+	double *values = scratch.allocate<double>(count);
+	int32_t *sizes = scratch.allocate<int32_t>(count);
+	uint8_t *types = scratch.allocate<uint8_t>(count);
+	uint16_t *conditions = scratch.allocate<uint16_t>(count);
+	uint16_t *exchanges = scratch.allocate<uint16_t>(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		times[i] = ticks[i].time;
+		values[i] = ticks[i].value;
+		sizes[i] = ticks[i].size;
+		types[i] = ticks[i].type;
+		conditions[i] = ticks[i].condition;
+		exchanges[i] = ticks[i].exchange;
+	}
+	TickColumns columns = { count, times, values, sizes, types, conditions, exchanges };
+	return columns;
+}
+
+template <typename T>
+inline const T *gatherColumn(const T *column, const uint32_t *order, uint32_t count,
+	Arena &scratch)
+{
+	T *sorted = scratch.allocate<T>(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		sorted[i] = column[order[i]];
+	}
+	return sorted;
+}
+
+// Checks batch against, and then moves, boundary. Everything out points
+// to is in scratch.
+inline void validateTicks(const TickColumns &batch, TickBoundary *boundary, Arena &scratch,
+	TickValidation *out)
+{
+	const uint32_t count = batch.count;
+	out->order = NULL;
+	out->unordered = 0;
+	for (uint32_t i = 1; i < count; ++i) {
+		out->unordered += batch.times[i] < batch.times[i - 1];
+	}
+
+	TickColumns c = batch;
+	if (out->unordered) {
+		// Insertion sort: stable, and about linear for the few ticks that
+		// are ever out of place
+		uint32_t *order = scratch.allocate<uint32_t>(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t index = i, j = i;
+			while (j > 0 && batch.times[order[j - 1]] > batch.times[index]) {
+				order[j] = order[j - 1];
+				--j;
+			}
+			order[j] = index;
+		}
+		c.times = gatherColumn(batch.times, order, count, scratch);
+		c.values = gatherColumn(batch.values, order, count, scratch);
+		c.sizes = gatherColumn(batch.sizes, order, count, scratch);
+		c.types = gatherColumn(batch.types, order, count, scratch);
+		c.conditions = gatherColumn(batch.conditions, order, count, scratch);
+		c.exchanges = gatherColumn(batch.exchanges, order, count, scratch);
+		out->order = order;
+	}
+
+	uint8_t *keep = scratch.allocate<uint8_t>(count);
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		keep[i] = (uint8_t)((c.values[i] == c.values[i]) & (c.sizes[i] > 0));
+		kept += keep[i];
+	}
+	out->invalid = count - kept;
+
+	out->stale = 0;
+	if (boundary->valid) {
+		const int64_t from = boundary->time;
+		for (uint32_t i = 0; i < count; ++i) {
+			uint8_t stale = keep[i] & (uint8_t)(c.times[i] < from);
+			out->stale += stale;
+			keep[i] ^= stale;
+		}
+	}
+
+	out->duplicate = 0;
+	if (boundary->valid) {
+		// Ticks at the boundary's time come first once the stale ones are
+		// out; those up to the last repeat of the boundary tick were taken
+		uint32_t overlap = 0;
+		for (uint32_t i = 0; i < count && c.times[i] <= boundary->time; ++i) {
+			if (keep[i] && c.times[i] == boundary->time && c.values[i] == boundary->value
+				&& c.sizes[i] == boundary->size && c.types[i] == boundary->type
+				&& c.conditions[i] == boundary->condition && c.exchanges[i] == boundary->exchange) {
+				overlap = i + 1;
+			}
+		}
+		for (uint32_t i = 0; i < overlap; ++i) {
+			out->duplicate += keep[i];
+			keep[i] = 0;
+		}
+	}
+	out->kept = kept - out->stale - out->duplicate;
+	out->keep = keep;
+
+	for (uint32_t i = count; i-- > 0; ) {
+		if (keep[i]) {
+			boundary->valid = true;
+			boundary->time = c.times[i];
+			boundary->value = c.values[i];
+			boundary->size = c.sizes[i];
+			boundary->type = c.types[i];
+			boundary->condition = c.conditions[i];
+			boundary->exchange = c.exchanges[i];
+			break;
+		}
+	}
+}
@@ -0,0 +1,190 @@
+// timeutil.h : GMT calendar arithmetic on epoch seconds
+//
+// Request windows are planned as plain integers so they can be split and
+// compared without going through localtime or the blpapi Datetime type.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+namespace timeutil {
+
+	const long long SECONDS_PER_DAY = 86400;
+
+	// Days since 1970-01-01 of a proleptic Gregorian date
+	inline long long daysFromCivil(int y, unsigned m, unsigned d)
+	{
+		y -= m <= 2;
+		const int era = (y >= 0 ? y : y - 399) / 400;
+		const unsigned yoe = (unsigned)(y - era * 400);
+		const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+		const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return (long long)era * 146097 + (long long)doe - 719468;
+	}
+
+	// Inverse of daysFromCivil
+	inline void civilFromDays(long long z, int *y, unsigned *m, unsigned *d)
+	{
+		z += 719468;
+		const long long era = (z >= 0 ? z : z - 146096) / 146097;
+		const unsigned doe = (unsigned)(z - era * 146097);
+		const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		const unsigned mp = (5 * doy + 2) / 153;
+		*d = doy - (153 * mp + 2) / 5 + 1;
+		*m = mp < 10 ? mp + 3 : mp - 9;
+		*y = (int)(yoe + era * 400) + (*m <= 2);
+	}
+
+	// 0 for Sunday through 6 for Saturday; 1970-01-01 was a Thursday
+	inline int weekday(long long days)
+	{
+		long long w = (days + 4) % 7;
+		return (int)(w < 0 ? w + 7 : w);
+	}
+
+	inline long long toEpoch(int y, unsigned mo, unsigned d,
+		unsigned h, unsigned mi, unsigned s)
+	{
+		return daysFromCivil(y, mo, d) * SECONDS_PER_DAY + h * 3600 + mi * 60 + s;
+	}
+
+	// Start of the GMT day containing epoch
+	inline long long floorDay(long long epoch)
+	{
+		long long days = epoch / SECONDS_PER_DAY;
+		if (epoch % SECONDS_PER_DAY < 0) {
+			--days;
+		}
+		return days * SECONDS_PER_DAY;
+	}
+
+	// Parses "YYYY-MM-DDTHH:MM:SS", ignoring any trailing fraction
+	inline bool parseDateTime(const std::string &str, long long *epoch)
+	{
+		int y, mo, d, h = 0, mi = 0, s = 0;
+		int n = sscanf(str.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d", &y, &mo, &d, &h, &mi, &s);
+		if (n != 3 && n != 6) {
+			return false;
+		}
+		if (mo < 1 || mo > 12 || d < 1 || d > 31
+			|| h < 0 || h > 23 || mi < 0 || mi > 59 || s < 0 || s > 60) {
+			return false;
+		}
+		*epoch = toEpoch(y, mo, d, h, mi, s);
+		return true;
+	}
+
+	// Formats as "YYYY-MM-DDTHH:MM:SS", which sorts the same as epoch
+	inline std::string formatDateTime(long long epoch)
+	{
+		long long day = floorDay(epoch);
+		long long secs = epoch - day;
+		int y;
+		unsigned mo, d;
+		civilFromDays(day / SECONDS_PER_DAY, &y, &mo, &d);
+
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%04d-%02u-%02uT%02d:%02d:%02d",
+			y, mo, d, (int)(secs / 3600), (int)(secs / 60 % 60), (int)(secs % 60));
+		return buf;
+	}
+
+	const long long NANOS_PER_SECOND = 1000000000LL;
+
+	// Days since 1970-01-01 of a time in epoch nanos
+	inline long long dayNumber(long long nanos)
+	{
+		const long long NANOS_PER_DAY = SECONDS_PER_DAY * NANOS_PER_SECOND;
+		long long day = nanos / NANOS_PER_DAY;
+		if (nanos % NANOS_PER_DAY < 0) {
+			--day;
+		}
+		return day;
+	}
+
+	inline bool parseDigits(const char *p, int n, int *out)
+	{
+		int v = 0;
+		for (int i = 0; i < n; ++i) {
+			if (p[i] < '0' || p[i] > '9') {
+				return false;
+			}
+			v = v * 10 + (p[i] - '0');
+		}
+		*out = v;
+		return true;
+	}
+
+	// Parses a tick time "YYYY-MM-DDTHH:MM:SS[.fffffffff]" into epoch nanos
+	// without going through sscanf or allocating
+	inline bool parseTickTime(const char *str, long long *nanos)
+	{
+		int y, mo, d, h, mi, s;
+		if (!parseDigits(str, 4, &y) || str[4] != '-'
+			|| !parseDigits(str + 5, 2, &mo) || str[7] != '-'
+			|| !parseDigits(str + 8, 2, &d) || str[10] != 'T'
+			|| !parseDigits(str + 11, 2, &h) || str[13] != ':'
+			|| !parseDigits(str + 14, 2, &mi) || str[16] != ':'
+			|| !parseDigits(str + 17, 2, &s)) {
+			return false;
+		}
+
+		long long fraction = 0;
+		int digits = 0;
+		if (str[19] == '.') {
+			for (const char *p = str + 20; *p >= '0' && *p <= '9'; ++p) {
+				if (digits < 9) {
+					fraction = fraction * 10 + (*p - '0');
+					++digits;
+				}
+			}
+		}
+		for (; digits < 9; ++digits) {
+			fraction *= 10;
+		}
+
+		*nanos = toEpoch(y, mo, d, h, mi, s) * NANOS_PER_SECOND + fraction;
+		return true;
+	}
+
+	inline void putDigits(char *p, int n, unsigned v)
+	{
+		for (int i = n - 1; i >= 0; --i) {
+			p[i] = (char)('0' + v % 10);
+			v /= 10;
+		}
+	}
+
+	// Writes "YYYY-MM-DDTHH:MM:SS.mmm" (23 chars, no terminator)
+	inline void formatTickTime(long long nanos, char *buf)
+	{
+		long long secs = nanos / NANOS_PER_SECOND;
+		long long frac = nanos % NANOS_PER_SECOND;
+		if (frac < 0) {
+			frac += NANOS_PER_SECOND;
+			--secs;
+		}
+		long long day = floorDay(secs);
+		unsigned tod = (unsigned)(secs - day);
+		int y;
+		unsigned mo, d;
+		civilFromDays(day / SECONDS_PER_DAY, &y, &mo, &d);
+
+		putDigits(buf, 4, (unsigned)y);
+		buf[4] = '-';
+		putDigits(buf + 5, 2, mo);
+		buf[7] = '-';
+		putDigits(buf + 8, 2, d);
+		buf[10] = 'T';
+		putDigits(buf + 11, 2, tod / 3600);
+		buf[13] = ':';
+		putDigits(buf + 14, 2, tod / 60 % 60);
+		buf[16] = ':';
+		putDigits(buf + 17, 2, tod % 60);
+		buf[19] = '.';
+		putDigits(buf + 20, 3, (unsigned)(frac / 1000000));
+	}
+}
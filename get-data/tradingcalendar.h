@@ -0,0 +1,362 @@
+// tradingcalendar.h : the trading sessions of each market, so requests go
+// out only for hours a security can trade in
+//
+// A security's market is the word before its yellow key, US in
+// "IBM US Equity". Each market has its session's local open and close,
+// its offset from GMT, the date rule it moves its clocks by and a rule for
+// its regular holidays. A session on local date D runs from D + open to
+// D + close, shifted to GMT by the offset of that date; weekends and
+// holidays have none. The built-in hours are wide enough for pre-market,
+// after-hours and closing auctions; a calendar file replaces or adds to
+// them, one entry per line:
+//
+//   market US 04:00 20:00 -5 us nyse
+//   holiday US 2018-12-05
+//   early US 2016-11-25 17:00
+//
+// A market line gives the local open and close, the offset from GMT in
+// hours, the DST rule and the holiday rule, which may be left out for none.
+// Holiday lines close their day besides the rule's, and early lines close
+// it at the time given.
+// DST rules are us (second Sunday of March to first Sunday of November),
+// eu (last Sunday of March to last Sunday of October) and none. Holiday
+// rules are nyse, lse, target (those Xetra and Euronext keep) and none;
+// holiday and early lines follow their market's market line, if any.
+// Blank lines and lines starting with # are skipped.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "chunkplanner.h"
+#include "timeutil.h"
+
+enum DstRule {
+	DST_NONE,
+	DST_US,
+	DST_EU
+};
+
+enum HolidayRule {
+	HOLIDAYS_NONE,
+	HOLIDAYS_NYSE,
+	HOLIDAYS_LSE,
+	HOLIDAYS_TARGET
+};
+
+struct MarketHours {
+	int							open;			// local seconds from midnight
+	int							close;			// after open, the same local day
+	int							gmtOffset;		// seconds, outside DST
+	DstRule						dst;
+	HolidayRule					holidayRule;
+	std::set<long long>			holidays;		// local day numbers
+	std::map<long long, int>	earlyCloses;	// local day number to close
+};
+
+namespace calendar {
+
+	// Day number of the nth Sunday of a month, or of its last for n = 0
+	inline long long sunday(int y, unsigned m, int n)
+	{
+		if (n == 0) {
+			long long last = m == 12 ? timeutil::daysFromCivil(y + 1, 1, 1) - 1
+				: timeutil::daysFromCivil(y, m + 1, 1) - 1;
+			return last - timeutil::weekday(last);
+		}
+		long long first = timeutil::daysFromCivil(y, m, 1);
+		return first + (7 - timeutil::weekday(first)) % 7 + 7 * (n - 1);
+	}
+
+	// The nth given weekday of a month, or its last for n = 0
+	inline long long nthWeekday(int y, unsigned m, int wday, int n)
+	{
+		if (n == 0) {
+			long long day = sunday(y, m, 0) + wday;
+			long long next = m == 12 ? timeutil::daysFromCivil(y + 1, 1, 1)
+				: timeutil::daysFromCivil(y, m + 1, 1);
+			return day < next ? day : day - 7;
+		}
+		long long first = timeutil::daysFromCivil(y, m, 1);
+		return first + (wday - timeutil::weekday(first) + 7) % 7 + 7 * (n - 1);
+	}
+
+	// Day number of Easter Sunday, by the anonymous Gregorian algorithm
+	inline long long easter(int y)
+	{
+		int a = y % 19, b = y / 100, c = y % 100;
+		int d = b / 4, e = b % 4, f = (b + 8) / 25, g = (b - f + 1) / 3;
+		int h = (19 * a + b - d - g + 15) % 30;
+		int i = c / 4, k = c % 4;
+		int l = (32 + 2 * e + 2 * i - h - k) % 7;
+		int m = (a + 11 * h + 22 * l) / 451;
+		int month = (h + l - 7 * m + 114) / 31;
+		int day = (h + l - 7 * m + 114) % 31 + 1;
+		return timeutil::daysFromCivil(y, month, day);
+	}
+
+	inline bool isDst(DstRule rule, long long day)
+	{
+		if (rule == DST_NONE) {
+			return false;
+		}
+		int y;
+		unsigned m, d;
+		timeutil::civilFromDays(day, &y, &m, &d);
+		if (rule == DST_US) {
+			return day >= sunday(y, 3, 2) && day < sunday(y, 11, 1);
+		}
+		return day >= sunday(y, 3, 0) && day < sunday(y, 10, 0);
+	}
+
+	// A fixed date, moved off the weekend as NYSE does: Saturday to the
+	// Friday before, Sunday to the Monday after
+	inline long long nyseObserved(long long day)
+	{
+		int w = timeutil::weekday(day);
+		return w == 6 ? day - 1 : w == 0 ? day + 1 : day;
+	}
+
+	inline bool isHoliday(HolidayRule rule, long long day)
+	{
+		if (rule == HOLIDAYS_NONE) {
+			return false;
+		}
+		int y;
+		unsigned m, d;
+		timeutil::civilFromDays(day, &y, &m, &d);
+		const long long goodFriday = easter(y) - 2;
+		const long long newYear = timeutil::daysFromCivil(y, 1, 1);
+		const long long christmas = timeutil::daysFromCivil(y, 12, 25);
+
+		if (rule == HOLIDAYS_NYSE) {
+			// New Year's Day on a Saturday is not moved
+			return day == goodFriday
+				|| (day == newYear && timeutil::weekday(day) != 6)
+				|| (timeutil::weekday(newYear) == 0 && day == newYear + 1)
+				|| day == nthWeekday(y, 1, 1, 3)			// Martin Luther King Jr. Day
+				|| day == nthWeekday(y, 2, 1, 3)			// Washington's Birthday
+				|| day == nthWeekday(y, 5, 1, 0)			// Memorial Day
+				|| (y >= 2022 && day == nyseObserved(timeutil::daysFromCivil(y, 6, 19)))
+				|| day == nyseObserved(timeutil::daysFromCivil(y, 7, 4))
+				|| day == nthWeekday(y, 9, 1, 1)			// Labor Day
+				|| day == nthWeekday(y, 11, 4, 4)			// Thanksgiving
+				|| day == nyseObserved(christmas);
+		}
+		if (rule == HOLIDAYS_LSE) {
+			// Weekend days move to the next free weekday
+			const int wChristmas = timeutil::weekday(christmas);
+			const int wNewYear = timeutil::weekday(newYear);
+			return day == goodFriday || day == goodFriday + 3
+				|| day == newYear + (wNewYear == 6 ? 2 : wNewYear == 0 ? 1 : 0)
+				|| day == nthWeekday(y, 5, 1, 1)			// Early May bank holiday
+				|| day == nthWeekday(y, 5, 1, 0)			// Spring bank holiday
+				|| day == nthWeekday(y, 8, 1, 0)			// Summer bank holiday
+				|| day == christmas || day == christmas + 1
+				|| (wChristmas == 6 && (day == christmas + 2 || day == christmas + 3))
+				|| (wChristmas == 0 && day == christmas + 2)
+				|| (wChristmas == 5 && day == christmas + 3);
+		}
+		return day == newYear || day == goodFriday || day == goodFriday + 3
+			|| day == timeutil::daysFromCivil(y, 5, 1)
+			|| day == christmas || day == christmas + 1;
+	}
+
+	// "HH:MM" as seconds from midnight, 24:00 included
+	inline bool parseClock(const char *str, int *seconds)
+	{
+		int h, m;
+		if (sscanf(str, "%2d:%2d", &h, &m) != 2 || h < 0 || m < 0 || m > 59
+			|| h * 60 + m > 24 * 60) {
+			return false;
+		}
+		*seconds = h * 3600 + m * 60;
+		return true;
+	}
+}
+
+class TradingCalendar {
+
+	std::map<std::string, MarketHours>	d_markets;
+
+	void addMarket(const char *code, int open, int close, int gmtOffset, DstRule dst,
+		HolidayRule holidays)
+	{
+		MarketHours &hours = d_markets[code];
+		hours.open = open;
+		hours.close = close;
+		hours.gmtOffset = gmtOffset;
+		hours.dst = dst;
+		hours.holidayRule = holidays;
+		hours.holidays.clear();
+		hours.earlyCloses.clear();
+	}
+
+	// The market's session on local day, false if it does not trade then
+	static bool session(const MarketHours &hours, long long day, TimeWindow *window)
+	{
+		int w = timeutil::weekday(day);
+		if (w == 0 || w == 6 || hours.holidays.count(day)
+			|| calendar::isHoliday(hours.holidayRule, day)) {
+			return false;
+		}
+		std::map<long long, int>::const_iterator early = hours.earlyCloses.find(day);
+		int close = early != hours.earlyCloses.end() ? early->second : hours.close;
+		long long gmt = day * timeutil::SECONDS_PER_DAY - hours.gmtOffset
+			- (calendar::isDst(hours.dst, day) ? 3600 : 0);
+		window->start = gmt + hours.open;
+		window->end = gmt + close;
+		return window->end > window->start;
+	}
+
+public:
+
+	TradingCalendar()
+	{
+		const int H = 3600;
+		addMarket("US", 4 * H, 20 * H, -5 * H, DST_US, HOLIDAYS_NYSE);
+		addMarket("UN", 4 * H, 20 * H, -5 * H, DST_US, HOLIDAYS_NYSE);
+		addMarket("UW", 4 * H, 20 * H, -5 * H, DST_US, HOLIDAYS_NYSE);
+		addMarket("UQ", 4 * H, 20 * H, -5 * H, DST_US, HOLIDAYS_NYSE);
+		addMarket("LN", 7 * H + 50 * 60, 16 * H + 40 * 60, 0, DST_EU, HOLIDAYS_LSE);
+		addMarket("GY", 9 * H, 17 * H + 40 * 60, 1 * H, DST_EU, HOLIDAYS_TARGET);
+		addMarket("FP", 9 * H, 17 * H + 40 * 60, 1 * H, DST_EU, HOLIDAYS_TARGET);
+		addMarket("NA", 9 * H, 17 * H + 40 * 60, 1 * H, DST_EU, HOLIDAYS_TARGET);
+		addMarket("JT", 9 * H, 15 * H + 30 * 60, 9 * H, DST_NONE, HOLIDAYS_NONE);
+		addMarket("HK", 9 * H + 30 * 60, 16 * H + 10 * 60, 8 * H, DST_NONE, HOLIDAYS_NONE);
+	}
+
+	// Adds the file's entries; false with the number of the first bad line,
+	// 0 if it could not be read
+	bool load(const std::string &path, int *badLine)
+	{
+		std::ifstream file(path.c_str());
+		if (!file) {
+			*badLine = 0;
+			return false;
+		}
+		std::string text;
+		for (int number = 1; std::getline(file, text); ++number) {
+			char kind[16], code[16], a[32], b[32], c[32], d[32], e[32];
+			int n = sscanf(text.c_str(), "%15s %15s %31s %31s %31s %31s %31s",
+				kind, code, a, b, c, d, e);
+			if (n <= 0 || kind[0] == '#') {
+				continue;
+			}
+			if (n < 3) {
+				*badLine = number;
+				return false;
+			}
+			std::map<std::string, MarketHours>::iterator market = d_markets.find(code);
+			long long day;
+			int open, close;
+			if (!strcmp(kind, "market") && (n == 6 || n == 7)
+				&& calendar::parseClock(a, &open) && calendar::parseClock(b, &close)
+				&& open < close) {
+				DstRule dst = !strcmp(d, "us") ? DST_US : !strcmp(d, "eu") ? DST_EU : DST_NONE;
+				HolidayRule holidays = n == 6 ? HOLIDAYS_NONE
+					: !strcmp(e, "nyse") ? HOLIDAYS_NYSE : !strcmp(e, "lse") ? HOLIDAYS_LSE
+					: !strcmp(e, "target") ? HOLIDAYS_TARGET : HOLIDAYS_NONE;
+				if ((dst == DST_NONE && strcmp(d, "none"))
+					|| (n == 7 && holidays == HOLIDAYS_NONE && strcmp(e, "none"))) {
+					*badLine = number;
+					return false;
+				}
+				addMarket(code, open, close, (int)(atof(c) * 3600), dst, holidays);
+			}
+			else if (!strcmp(kind, "holiday") && n == 3 && market != d_markets.end()
+				&& timeutil::parseDateTime(a, &day)) {
+				market->second.holidays.insert(day / timeutil::SECONDS_PER_DAY);
+			}
+			else if (!strcmp(kind, "early") && n == 4 && market != d_markets.end()
+				&& timeutil::parseDateTime(a, &day) && calendar::parseClock(b, &close)) {
+				market->second.earlyCloses[day / timeutil::SECONDS_PER_DAY] = close;
+			}
+			else {
+				*badLine = number;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// The code before the yellow key, empty if there is none
+	static std::string marketOf(const std::string &security)
+	{
+		size_t key = security.find_last_of(' ');
+		if (key == std::string::npos || key == 0) {
+			return std::string();
+		}
+		size_t end = security.find_last_not_of(' ', key);
+		size_t begin = security.find_last_of(' ', end);
+		if (end == std::string::npos || begin == std::string::npos) {
+			return std::string();
+		}
+		std::string code = security.substr(begin + 1, end - begin);
+		for (size_t i = 0; i < code.size(); ++i) {
+			code[i] = (char)toupper((unsigned char)code[i]);
+		}
+		return code;
+	}
+
+	const MarketHours *market(const std::string &security) const
+	{
+		std::map<std::string, MarketHours>::const_iterator it = d_markets.find(marketOf(security));
+		return it == d_markets.end() ? NULL : &it->second;
+	}
+
+	// Appends the security's sessions within [start, end], in order and
+	// clipped to it, as windows of a plan: a session cut short by end keeps
+	// end. False if its market is not known.
+	bool sessions(const std::string &security, long long start, long long end,
+		std::vector<TimeWindow> *windows) const
+	{
+		const MarketHours *hours = market(security);
+		if (!hours) {
+			return false;
+		}
+		// Local dates run up to a day either side of GMT's
+		long long last = timeutil::floorDay(end) / timeutil::SECONDS_PER_DAY + 1;
+		for (long long day = timeutil::floorDay(start) / timeutil::SECONDS_PER_DAY - 1;
+			day <= last; ++day) {
+			TimeWindow s;
+			if (!session(*hours, day, &s) || s.end <= start || s.start > end) {
+				continue;
+			}
+			TimeWindow w = { s.start > start ? s.start : start, s.end < end ? s.end : end };
+			if (w.start < w.end) {
+				windows->push_back(w);
+			}
+		}
+		return true;
+	}
+
+	// The last session of the security's market to have closed by now, as
+	// [start, end); for an unknown market the last whole weekday GMT
+	bool lastSession(const std::string &security, long long now, TimeWindow *window) const
+	{
+		const MarketHours *hours = market(security);
+		long long today = timeutil::floorDay(now) / timeutil::SECONDS_PER_DAY;
+		for (long long day = today; day > today - 32; --day) {
+			if (hours) {
+				if (session(*hours, day, window) && window->end <= now) {
+					return true;
+				}
+			}
+			else if (day < today && timeutil::weekday(day) != 0 && timeutil::weekday(day) != 6) {
+				window->start = day * timeutil::SECONDS_PER_DAY;
+				window->end = window->start + timeutil::SECONDS_PER_DAY;
+				return true;
+			}
+		}
+		return false;
+	}
+};
@@ -0,0 +1,110 @@
+// workqueues.h : one queue of work items per session, with stealing
+//
+// Each session sends from the front of its own queue. Once that is empty
+// it takes from the back of the longest other queue, so a slow or downed
+// host only keeps the work nobody else has got round to. Items are dealt
+// out up front; retries and requests a dead session still owed go back on
+// the front of a queue. Not thread safe; callers hold their scheduling
+// lock.
+//
+
+#pragma once
+
+#include <stddef.h>
+
+#include <deque>
+#include <vector>
+
+class WorkQueues {
+
+	std::vector<std::deque<size_t> >	d_queues;
+	size_t								d_stolen;
+
+public:
+
+	explicit WorkQueues(size_t count = 1)
+		: d_queues(count ? count : 1)
+		, d_stolen(0)
+	{
+	}
+
+	void resize(size_t count)
+	{
+		d_queues.resize(count ? count : 1);
+	}
+
+	size_t queues() const
+	{
+		return d_queues.size();
+	}
+
+	void pushBack(size_t queue, size_t item)
+	{
+		d_queues[queue].push_back(item);
+	}
+
+	void pushFront(size_t queue, size_t item)
+	{
+		d_queues[queue].push_front(item);
+	}
+
+	// Items queue would get: its own, or else anyone's
+	bool hasWork(size_t queue) const
+	{
+		return !d_queues[queue].empty() || !empty();
+	}
+
+	bool empty() const
+	{
+		for (size_t q = 0; q < d_queues.size(); ++q) {
+			if (!d_queues[q].empty()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	size_t size() const
+	{
+		size_t total = 0;
+		for (size_t q = 0; q < d_queues.size(); ++q) {
+			total += d_queues[q].size();
+		}
+		return total;
+	}
+
+	size_t size(size_t queue) const
+	{
+		return d_queues[queue].size();
+	}
+
+	// The next item for queue's session; false if every queue is empty
+	bool pop(size_t queue, size_t *item)
+	{
+		std::deque<size_t> &own = d_queues[queue];
+		if (!own.empty()) {
+			*item = own.front();
+			own.pop_front();
+			return true;
+		}
+		size_t victim = queue;
+		for (size_t q = 0; q < d_queues.size(); ++q) {
+			if (d_queues[q].size() > (victim == queue ? 0 : d_queues[victim].size())) {
+				victim = q;
+			}
+		}
+		if (victim == queue) {
+			return false;
+		}
+		*item = d_queues[victim].back();
+		d_queues[victim].pop_back();
+		++d_stolen;
+		return true;
+	}
+
+	// Items taken from another session's queue
+	size_t stolen() const
+	{
+		return d_stolen;
+	}
+};
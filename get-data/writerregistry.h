@@ -0,0 +1,136 @@
+// writerregistry.h : bounded cache of open output files
+//
+// Files are keyed by (security, day) and kept open across date changes and
+// interleaved securities, up to a fixed number of handles. The least
+// recently used file is closed to make room; reopening it later appends.
+//
+
+#pragma once
+
+#include <limits.h>
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+template <typename SINK>
+class WriterRegistry {
+
+	typedef std::pair<size_t, long long>	Key;	// security index, day number
+
+	struct Entry {
+		Key							key;
+		SINK						sink;
+	};
+
+	typedef std::list<Entry>		EntryList;
+
+	EntryList						d_lru;			// most recently used first
+	std::map<Key, typename EntryList::iterator>	d_index;
+	size_t							d_capacity;
+	size_t							d_opens;
+	size_t							d_evictions;
+
+	WriterRegistry(const WriterRegistry &);
+	WriterRegistry &operator=(const WriterRegistry &);
+
+	void erase(typename EntryList::iterator it)
+	{
+		d_index.erase(it->key);
+		d_lru.erase(it);
+	}
+
+public:
+
+	explicit WriterRegistry(size_t capacity = 64)
+		: d_capacity(capacity ? capacity : 1)
+		, d_opens(0)
+		, d_evictions(0)
+	{
+	}
+
+	void setCapacity(size_t capacity)
+	{
+		d_capacity = capacity ? capacity : 1;
+	}
+
+	// The open sink for (security, day), opening path if it is not open
+	// already. NULL if the file cannot be opened.
+	SINK *acquire(size_t security, long long day, const std::string &path)
+	{
+		Key key(security, day);
+		typename std::map<Key, typename EntryList::iterator>::iterator found = d_index.find(key);
+		if (found != d_index.end()) {
+			d_lru.splice(d_lru.begin(), d_lru, found->second);
+			return &found->second->sink;
+		}
+
+		while (d_lru.size() >= d_capacity) {
+			erase(--d_lru.end());
+			++d_evictions;
+		}
+
+		d_lru.emplace_front();
+		Entry &entry = d_lru.front();
+		entry.key = key;
+		if (!entry.sink.open(path)) {
+			d_lru.pop_front();
+			return NULL;
+		}
+		d_index[key] = d_lru.begin();
+		++d_opens;
+		return &entry.sink;
+	}
+
+	// The sink for (security, day) if it is open; does not count as a use
+	SINK *find(size_t security, long long day)
+	{
+		typename std::map<Key, typename EntryList::iterator>::iterator found
+			= d_index.find(Key(security, day));
+		return found == d_index.end() ? NULL : &found->second->sink;
+	}
+
+	// Closes every file of one security
+	void closeSecurity(size_t security)
+	{
+		typename std::map<Key, typename EntryList::iterator>::iterator it
+			= d_index.lower_bound(Key(security, LLONG_MIN));
+		while (it != d_index.end() && it->first.first == security) {
+			d_lru.erase(it->second);
+			it = d_index.erase(it);
+		}
+	}
+
+	// Everything written so far is on disk, in every open file
+	void flushAll()
+	{
+		for (typename EntryList::iterator it = d_lru.begin(); it != d_lru.end(); ++it) {
+			it->sink.flush();
+		}
+	}
+
+	void closeAll()
+	{
+		d_index.clear();
+		d_lru.clear();
+	}
+
+	size_t openCount() const
+	{
+		return d_lru.size();
+	}
+
+	// Files opened, reopens after eviction included
+	size_t opens() const
+	{
+		return d_opens;
+	}
+
+	// Bumped whenever a file is closed to make room, so callers holding a
+	// sink pointer know to look it up again
+	size_t evictions() const
+	{
+		return d_evictions;
+	}
+};